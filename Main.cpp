@@ -6,6 +6,8 @@
 #include "Move.h"
 #include "Piece.h"
 #include "PlaySide.h"
+#include "ttables.h"
+#include "strategy.h"
 
 static PlaySide sideToMove;
 static PlaySide engineSide;
@@ -37,6 +39,8 @@ static std::string constructFeaturesPayload() {
           << " ping=0"
           << " setboard=0"
           << " level=0"
+          << " memory=1"
+          << " smp=1"
           << " variants=\"crazyhouse\""
           << " name=\"" << Bot::getBotName() << "\" myname=\""
           << Bot::getBotName() << "\" done=1\n";
@@ -142,6 +146,10 @@ class EngineComponents {
 
       while (true) {
           getline(scanner, command);
+          if (command.rfind("memory ", 0) == 0)
+              resize_table(std::stoul(command.substr(strlen("memory "))));
+          if (command.rfind("cores ", 0) == 0)
+              set_search_threads(std::stoi(command.substr(strlen("cores "))));
           if (command == "new" || command == "force" || command == "go" || command == "quit") {
               bufferedCmd = command;
               break;
@@ -158,6 +166,7 @@ class EngineComponents {
       engineSide = PlaySide::NONE;
       sideToMove = PlaySide::WHITE;
       isStarted = false;
+      clear_entries();
   }
 
   void enterForceMode() {
@@ -240,6 +249,14 @@ class EngineComponents {
       enterForceMode();
     } else if (command == "go") {
       leaveForceMode();
+    } else if (command == "memory") {
+      std::string megabytes;
+      getline(command_stream, megabytes, ' ');
+      resize_table(std::stoul(megabytes));
+    } else if (command == "cores") {
+      std::string threads;
+      getline(command_stream, threads, ' ');
+      set_search_threads(std::stoi(threads));
     } else if (command == "usermove") {
       std::string movePayload;
       getline(command_stream, movePayload, ' ');
@@ -252,6 +269,8 @@ class EngineComponents {
 };
 
 int main() {
+  init_bitboards();
+
   EngineComponents* engine = new EngineComponents();
   engine->performHandshake();
 
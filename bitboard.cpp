@@ -0,0 +1,156 @@
+#include "bitboard.h"
+
+constexpr int knight_dx[] = {-2, -2, -1, -1, 1, 1, 2, 2};
+constexpr int knight_dy[] = {-1, 1, -2, 2, -2, 2, -1, 1};
+
+constexpr int king_dx[] = {-1, -1, -1, 0, 0, 1, 1, 1};
+constexpr int king_dy[] = {-1, 0, 1, -1, 1, -1, 0, 1};
+
+constexpr int rook_dx[] = {-1, 1, 0, 0};
+constexpr int rook_dy[] = {0, 0, -1, 1};
+
+constexpr int bishop_dx[] = {-1, -1, 1, 1};
+constexpr int bishop_dy[] = {-1, 1, -1, 1};
+
+Bitboard knight_attacks[SQUARE_NB];
+Bitboard king_attacks[SQUARE_NB];
+Bitboard pawn_attacks[2][SQUARE_NB];
+
+Bitboard between_bb[SQUARE_NB][SQUARE_NB];
+Bitboard line_bb[SQUARE_NB][SQUARE_NB];
+
+Magic rook_magics[SQUARE_NB];
+Magic bishop_magics[SQUARE_NB];
+
+// sum over all squares of 2^(relevant blockers)
+static Bitboard rook_attack_table[0x19000];
+static Bitboard bishop_attack_table[0x1480];
+
+inline bool on_board(int x, int y) {
+  return x >= 1 && x <= 8 && y >= 1 && y <= 8;
+}
+
+// walks every ray until it leaves the board or hits an occupied square (included)
+static Bitboard sliding_attacks(int sq, Bitboard occupied, const int *dx, const int *dy) {
+  Bitboard attacks = 0;
+  for (int i = 0; i < 4; ++i) {
+    int x = square_x(sq) + dx[i];
+    int y = square_y(sq) + dy[i];
+    for (; on_board(x, y); x += dx[i], y += dy[i]) {
+      attacks |= square_bb(make_square(x, y));
+      if (occupied & square_bb(make_square(x, y)))
+        break;
+    }
+  }
+  return attacks;
+}
+
+#ifndef USE_PEXT
+// xorshift64*, seeded with a constant so the magics are the same on every start
+static uint64_t magic_seed = 1070372;
+
+static uint64_t magic_rand() {
+  magic_seed ^= magic_seed >> 12;
+  magic_seed ^= magic_seed << 25;
+  magic_seed ^= magic_seed >> 27;
+  return magic_seed * 2685821657736338717ULL;
+}
+
+// magics with few set bits are found much faster
+static uint64_t sparse_rand() {
+  return magic_rand() & magic_rand() & magic_rand();
+}
+#endif
+
+static void init_magics(Bitboard *table, Magic *magics, const int *dx, const int *dy) {
+  Bitboard reference[4096];
+#ifndef USE_PEXT
+  Bitboard occupancy[4096];
+  int epoch[4096] = {}, attempt = 0;
+#endif
+  int size = 0;
+
+  for (int sq = 0; sq < SQUARE_NB; ++sq) {
+    // blockers on the board edge never change the attack set
+    Bitboard edges = ((RANK_1 | RANK_8) & ~rank_bb(sq)) | ((FILE_A | FILE_H) & ~file_bb(sq));
+    Magic &m = magics[sq];
+    m.mask = sliding_attacks(sq, 0, dx, dy) & ~edges;
+    m.shift = 64 - popcount(m.mask);
+    m.attacks = (sq == 0) ? table : magics[sq - 1].attacks + size;
+
+    // enumerate every subset of the mask (carry-rippler)
+    Bitboard b = 0;
+    size = 0;
+    do {
+      reference[size] = sliding_attacks(sq, b, dx, dy);
+#ifdef USE_PEXT
+      m.attacks[m.index(b)] = reference[size];
+#else
+      occupancy[size] = b;
+#endif
+      ++size;
+      b = (b - m.mask) & m.mask;
+    } while (b);
+
+#ifndef USE_PEXT
+    // try random magics until one maps every subset without a destructive collision
+    for (int i = 0; i < size; ) {
+      for (m.magic = 0; popcount((m.magic * m.mask) >> 56) < 6; )
+        m.magic = sparse_rand();
+
+      ++attempt;
+      for (i = 0; i < size; ++i) {
+        unsigned idx = m.index(occupancy[i]);
+        if (epoch[idx] < attempt) {
+          epoch[idx] = attempt;
+          m.attacks[idx] = reference[i];
+        } else if (m.attacks[idx] != reference[i]) {
+          break;
+        }
+      }
+    }
+#endif
+  }
+}
+
+void init_bitboards() {
+  for (int sq = 0; sq < SQUARE_NB; ++sq) {
+    int x = square_x(sq);
+    int y = square_y(sq);
+
+    knight_attacks[sq] = king_attacks[sq] = 0;
+    for (int i = 0; i < 8; ++i) {
+      if (on_board(x + knight_dx[i], y + knight_dy[i]))
+        knight_attacks[sq] |= square_bb(make_square(x + knight_dx[i], y + knight_dy[i]));
+      if (on_board(x + king_dx[i], y + king_dy[i]))
+        king_attacks[sq] |= square_bb(make_square(x + king_dx[i], y + king_dy[i]));
+    }
+
+    pawn_attacks[PlaySide::WHITE][sq] = pawn_attacks[PlaySide::BLACK][sq] = 0;
+    for (int dx = -1; dx <= 1; dx += 2) {
+      if (on_board(x + dx, y + 1))
+        pawn_attacks[PlaySide::WHITE][sq] |= square_bb(make_square(x + dx, y + 1));
+      if (on_board(x + dx, y - 1))
+        pawn_attacks[PlaySide::BLACK][sq] |= square_bb(make_square(x + dx, y - 1));
+    }
+  }
+
+  init_magics(rook_attack_table, rook_magics, rook_dx, rook_dy);
+  init_magics(bishop_attack_table, bishop_magics, bishop_dx, bishop_dy);
+
+  for (int s1 = 0; s1 < SQUARE_NB; ++s1) {
+    for (int s2 = 0; s2 < SQUARE_NB; ++s2) {
+      between_bb[s1][s2] = line_bb[s1][s2] = 0;
+      if (s1 == s2)
+        continue;
+
+      if (bishop_attacks(s1, 0) & square_bb(s2)) {
+        line_bb[s1][s2] = (bishop_attacks(s1, 0) & bishop_attacks(s2, 0)) | square_bb(s1) | square_bb(s2);
+        between_bb[s1][s2] = bishop_attacks(s1, square_bb(s2)) & bishop_attacks(s2, square_bb(s1));
+      } else if (rook_attacks(s1, 0) & square_bb(s2)) {
+        line_bb[s1][s2] = (rook_attacks(s1, 0) & rook_attacks(s2, 0)) | square_bb(s1) | square_bb(s2);
+        between_bb[s1][s2] = rook_attacks(s1, square_bb(s2)) & rook_attacks(s2, square_bb(s1));
+      }
+    }
+  }
+}
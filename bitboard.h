@@ -0,0 +1,116 @@
+#ifndef CHESSBOT_BITBOARD_HPP
+#define CHESSBOT_BITBOARD_HPP
+#include <cstdint>
+#include "PlaySide.h"
+
+#if defined(__BMI2__)
+#include <immintrin.h>
+#define USE_PEXT
+#endif
+
+/**
+ * A bitboard is a set of squares, one bit per square.
+ * Square index is (y - 1) * 8 + (x - 1), so a1 = 0, h1 = 7, a8 = 56, h8 = 63,
+ * where x is the file and y is the rank, both 1-based like GameState::board.
+ */
+typedef uint64_t Bitboard;
+
+constexpr int SQUARE_NB = 64;
+
+constexpr Bitboard RANK_1 = 0xFFULL;
+constexpr Bitboard RANK_2 = RANK_1 << 8;
+constexpr Bitboard RANK_7 = RANK_1 << 48;
+constexpr Bitboard RANK_8 = RANK_1 << 56;
+constexpr Bitboard FILE_A = 0x0101010101010101ULL;
+constexpr Bitboard FILE_H = FILE_A << 7;
+
+// pawns can not be dropped on the first and last rank
+constexpr Bitboard PAWN_DROP_MASK = ~(RANK_1 | RANK_8);
+
+constexpr int make_square(int x, int y) {
+  return (y - 1) * 8 + (x - 1);
+}
+
+constexpr int square_x(int sq) {
+  return (sq & 7) + 1;
+}
+
+constexpr int square_y(int sq) {
+  return (sq >> 3) + 1;
+}
+
+constexpr Bitboard square_bb(int sq) {
+  return 1ULL << sq;
+}
+
+constexpr Bitboard rank_bb(int sq) {
+  return RANK_1 << (sq & ~7);
+}
+
+constexpr Bitboard file_bb(int sq) {
+  return FILE_A << (sq & 7);
+}
+
+inline int popcount(Bitboard b) {
+  return __builtin_popcountll(b);
+}
+
+inline int lsb(Bitboard b) {
+  return __builtin_ctzll(b);
+}
+
+// returns the lowest square of the set and removes it
+inline int pop_lsb(Bitboard &b) {
+  int sq = lsb(b);
+  b &= b - 1;
+  return sq;
+}
+
+extern Bitboard knight_attacks[SQUARE_NB];
+extern Bitboard king_attacks[SQUARE_NB];
+// squares attacked by a pawn of the given color standing on the square
+extern Bitboard pawn_attacks[2][SQUARE_NB];
+
+/**
+ * Sliding attacks are looked up in precomputed tables. The relevant blockers
+ * (the rays without the board edge) are hashed into an index, with BMI2 pext
+ * when the compiler targets it and with magic multiplication otherwise.
+ */
+struct Magic {
+  Bitboard mask;
+  Bitboard magic;
+  Bitboard *attacks;
+  unsigned shift;
+
+  unsigned index(Bitboard occupied) const {
+#ifdef USE_PEXT
+    return (unsigned)_pext_u64(occupied, mask);
+#else
+    return (unsigned)(((occupied & mask) * magic) >> shift);
+#endif
+  }
+};
+
+extern Magic rook_magics[SQUARE_NB];
+extern Magic bishop_magics[SQUARE_NB];
+
+inline Bitboard rook_attacks(int sq, Bitboard occupied) {
+  return rook_magics[sq].attacks[rook_magics[sq].index(occupied)];
+}
+
+inline Bitboard bishop_attacks(int sq, Bitboard occupied) {
+  return bishop_magics[sq].attacks[bishop_magics[sq].index(occupied)];
+}
+
+inline Bitboard queen_attacks(int sq, Bitboard occupied) {
+  return rook_attacks(sq, occupied) | bishop_attacks(sq, occupied);
+}
+
+// squares strictly between two squares on a common line, empty if they are not aligned
+extern Bitboard between_bb[SQUARE_NB][SQUARE_NB];
+// the whole line through two aligned squares (edge to edge), empty if they are not aligned
+extern Bitboard line_bb[SQUARE_NB][SQUARE_NB];
+
+void init_bitboards();
+
+#endif // CHESSBOT_BITBOARD_HPP
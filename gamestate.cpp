@@ -1,218 +1,393 @@
 #include "strategy.h"
 #include "gamestate.h"
+#include "ttables.h"
 #include "pieces.h"
 #include "moves.h"
+#include <cassert>
 #include <random>
 
-constexpr int knight_dx[] = {-2, -2, -1, -1, 1, 1, 2, 2};
-constexpr int knight_dy[] = {-1, 1, -2, 2, -2, 2, -1, 1};
-
-constexpr int king_dx[] = {-1, -1, -1, 0, 0, 1, 1, 1};
-constexpr int king_dy[] = {-1, 0, 1, -1, 1, -1, 0, 1};
-
-int en_passant_opportunity[3];
+// castling rights lost when a piece moves from or to the square
+static int castling_lost(int sq) {
+  switch (sq) {
+    case make_square(5, 1):
+      return WHITE_OO | WHITE_OOO;
+    case make_square(8, 1):
+      return WHITE_OO;
+    case make_square(1, 1):
+      return WHITE_OOO;
+    case make_square(5, 8):
+      return BLACK_OO | BLACK_OOO;
+    case make_square(8, 8):
+      return BLACK_OO;
+    case make_square(1, 8):
+      return BLACK_OOO;
+    default:
+      return 0;
+  }
+}
 
 GameState::GameState() {
   for (int i = 1; i <= BOARD_SIZE; ++i)
     for (int j = 1; j <= BOARD_SIZE; ++j)
-      board[i][j] = nullptr;
+      board[i][j] = NO_PIECE;
+
+  for (int i = 0; i < 2; ++i) {
+    for (int j = 0; j < 6; ++j) {
+      pieces[i][j] = 0;
+      hand[i][j] = 0;
+      attacked_by[i][j] = 0;
+      std::fill(attack_count[i][j], attack_count[i][j] + SQUARE_NB, 0);
+    }
+    occupied[i] = 0;
+    std::fill(attackers[i], attackers[i] + SQUARE_NB, 0);
+  }
+  std::fill(attacks_from, attacks_from + SQUARE_NB, 0);
+  all = 0;
+  ply = 0;
+  color = PlaySide::WHITE;
+  castling = WHITE_OO | WHITE_OOO | BLACK_OO | BLACK_OOO;
+  ep_square = NO_SQUARE;
+  key = zobrist.castling[castling];
+  pawn_key = 0;
 
   for (int i = 1; i <= BOARD_SIZE; ++i) {
-    board[i][2] = new Pawn(PlaySide::WHITE);
-    board[i][7] = new Pawn(PlaySide::BLACK);
+    put_piece(i, 2, make_piece(Piece::PAWN, PlaySide::WHITE));
+    put_piece(i, 7, make_piece(Piece::PAWN, PlaySide::BLACK));
   }
 
   auto color = PlaySide::WHITE;
   for (int i = 1; i <= BOARD_SIZE; i += 7) {
-    board[1][i] = new Rook(color);
-    board[2][i] = new Knight(color);
-    board[3][i] = new Bishop(color);
-    board[4][i] = new Queen(color);
-    board[5][i] = new King(color);
-    board[6][i] = new Bishop(color);
-    board[7][i] = new Knight(color);
-    board[8][i] = new Rook(color);
+    put_piece(1, i, make_piece(Piece::ROOK, color));
+    put_piece(2, i, make_piece(Piece::KNIGHT, color));
+    put_piece(3, i, make_piece(Piece::BISHOP, color));
+    put_piece(4, i, make_piece(Piece::QUEEN, color));
+    put_piece(5, i, make_piece(Piece::KING, color));
+    put_piece(6, i, make_piece(Piece::BISHOP, color));
+    put_piece(7, i, make_piece(Piece::KNIGHT, color));
+    put_piece(8, i, make_piece(Piece::ROOK, color));
     color = PlaySide::BLACK;
   }
 }
 
-std::pair<int, int> GameState::king_pos(PlaySide king_color) {
-  for (int i = 1; i <= BOARD_SIZE; ++i)
-    for (int j = 1; j <= BOARD_SIZE; ++j)
-      if (board[i][j] != nullptr && board[i][j]->get_type() == Piece::KING && board[i][j]->get_color() == king_color)
-        return {i, j};
-  // wont get here
-  return {-1, -1};
+int64_t GameState::hash() const {
+  return key ^ side_key(color);
 }
 
-bool GameState::square_check(int x, int y) {
-  // check if a queen / rook checks the square
-  for (int dist = 1; dist + x <= 8; ++dist) {
-    if (board[dist + x][y] != nullptr) {
-      if (board[dist + x][y]->get_color() != color &&
-        (board[dist + x][y]->get_type() == Piece::ROOK || board[dist + x][y]->get_type() == Piece::QUEEN))
-        return true;
-      break;
-    }
-  }
+Bitboard GameState::sliders_to(int sq) const {
+  return (rook_attacks(sq, all) & (pieces[0][Piece::ROOK] | pieces[1][Piece::ROOK]
+                                   | pieces[0][Piece::QUEEN] | pieces[1][Piece::QUEEN]))
+    | (bishop_attacks(sq, all) & (pieces[0][Piece::BISHOP] | pieces[1][Piece::BISHOP]
+                                  | pieces[0][Piece::QUEEN] | pieces[1][Piece::QUEEN]));
+}
 
-  for (int dist = 1; -dist + x >= 1; ++dist) {
-    if (board[-dist + x][y] != nullptr) {
-      if (board[-dist + x][y]->get_color() != color &&
-        (board[-dist + x][y]->get_type() == Piece::ROOK || board[-dist + x][y]->get_type() == Piece::QUEEN))
-        return true;
-      break;
-    }
+void GameState::add_attacks(int sq) {
+  PieceCode piece = board[square_x(sq)][square_y(sq)];
+  PlaySide side = piece_color(piece);
+  Piece type = piece_type(piece);
+  Bitboard b = attacks_from[sq] = piece_attacks(piece, sq, all);
+  while (b) {
+    int to = pop_lsb(b);
+    if (attack_count[side][type][to]++ == 0)
+      attacked_by[side][type] |= square_bb(to);
+    ++attackers[side][to];
   }
+}
 
-  for (int dist = 1; dist + y <= 8; ++dist) {
-    if (board[x][dist + y] != nullptr) {
-      if (board[x][dist + y]->get_color() != color && 
-        (board[x][dist + y]->get_type() == Piece::ROOK || board[x][dist + y]->get_type() == Piece::QUEEN))
-        return true;
-      break;
-    }
+void GameState::remove_attacks(int sq) {
+  PieceCode piece = board[square_x(sq)][square_y(sq)];
+  PlaySide side = piece_color(piece);
+  Piece type = piece_type(piece);
+  Bitboard b = attacks_from[sq];
+  attacks_from[sq] = 0;
+  while (b) {
+    int to = pop_lsb(b);
+    if (--attack_count[side][type][to] == 0)
+      attacked_by[side][type] ^= square_bb(to);
+    --attackers[side][to];
   }
+}
 
-  for (int dist = 1; -dist + y >= 1; ++dist) {
-    if (board[x][-dist + y] != nullptr) {
-      if (board[x][-dist + y]->get_color() != color && 
-        (board[x][-dist + y]->get_type() == Piece::ROOK || board[x][-dist + y]->get_type() == Piece::QUEEN))
-        return true;
-      break;
-    }
+void GameState::put_piece(int x, int y, PieceCode piece) {
+  int sq = make_square(x, y);
+  Bitboard b = square_bb(sq);
+  // the sliders that saw through sq stop on it now
+  Bitboard sliders = sliders_to(sq);
+  for (Bitboard s = sliders; s; )
+    remove_attacks(pop_lsb(s));
+
+  board[x][y] = piece;
+  pieces[piece_color(piece)][piece_type(piece)] |= b;
+  occupied[piece_color(piece)] |= b;
+  all |= b;
+  key ^= piece_key(piece, sq);
+  if (piece_type(piece) == Piece::PAWN)
+    pawn_key ^= piece_key(piece, sq);
+  if (piece_type(piece) == Piece::KING)
+    king_square[piece_color(piece)] = sq;
+
+  while (sliders)
+    add_attacks(pop_lsb(sliders));
+  add_attacks(sq);
+}
+
+PieceCode GameState::remove_piece(int x, int y) {
+  int sq = make_square(x, y);
+  Bitboard b = square_bb(sq);
+  // the sliders that stopped on sq see through it now
+  Bitboard sliders = sliders_to(sq);
+  remove_attacks(sq);
+  for (Bitboard s = sliders; s; )
+    remove_attacks(pop_lsb(s));
+
+  PieceCode piece = board[x][y];
+  board[x][y] = NO_PIECE;
+  pieces[piece_color(piece)][piece_type(piece)] ^= b;
+  occupied[piece_color(piece)] ^= b;
+  all ^= b;
+  key ^= piece_key(piece, sq);
+  if (piece_type(piece) == Piece::PAWN)
+    pawn_key ^= piece_key(piece, sq);
+
+  while (sliders)
+    add_attacks(pop_lsb(sliders));
+  return piece;
+}
+
+void GameState::move_piece(int x, int y, int new_x, int new_y) {
+  put_piece(new_x, new_y, remove_piece(x, y));
+}
+
+void GameState::add_to_hand(PlaySide side, Piece type) {
+  key ^= hand_key(side, type, hand[side][type]);
+  ++hand[side][type];
+  key ^= hand_key(side, type, hand[side][type]);
+}
+
+void GameState::remove_from_hand(PlaySide side, Piece type) {
+  key ^= hand_key(side, type, hand[side][type]);
+  --hand[side][type];
+  key ^= hand_key(side, type, hand[side][type]);
+}
+
+Piece GameState::hand_type(PieceCode piece) {
+  return is_promoted(piece) ? Piece::PAWN : piece_type(piece);
+}
+
+bool GameState::in_check() const {
+  return attackers[reverse_color(color)][king_square[color]] > 0;
+}
+
+bool GameState::square_check(int x, int y) {
+  return attackers[reverse_color(color)][make_square(x, y)] > 0;
+}
+
+bool GameState::king_check(int x, int y) {
+  return square_check(x, y);
+}
+
+Bitboard GameState::attackers_to(int sq, Bitboard occupancy) const {
+  return (pawn_attacks[PlaySide::BLACK][sq] & pieces[PlaySide::WHITE][Piece::PAWN])
+    | (pawn_attacks[PlaySide::WHITE][sq] & pieces[PlaySide::BLACK][Piece::PAWN])
+    | (knight_attacks[sq] & (pieces[0][Piece::KNIGHT] | pieces[1][Piece::KNIGHT]))
+    | (king_attacks[sq] & (pieces[0][Piece::KING] | pieces[1][Piece::KING]))
+    | (rook_attacks(sq, occupancy) & (pieces[0][Piece::ROOK] | pieces[1][Piece::ROOK]
+                                      | pieces[0][Piece::QUEEN] | pieces[1][Piece::QUEEN]))
+    | (bishop_attacks(sq, occupancy) & (pieces[0][Piece::BISHOP] | pieces[1][Piece::BISHOP]
+                                        | pieces[0][Piece::QUEEN] | pieces[1][Piece::QUEEN]));
+}
+
+Bitboard GameState::attacked_squares(PlaySide side, bool with_king) const {
+  return attacked_by[side][Piece::PAWN] | attacked_by[side][Piece::KNIGHT] | attacked_by[side][Piece::BISHOP]
+    | attacked_by[side][Piece::ROOK] | attacked_by[side][Piece::QUEEN]
+    | (with_king ? attacked_by[side][Piece::KING] : 0);
+}
+
+Bitboard GameState::pinned_pieces(int king_sq) const {
+  const Bitboard *enemy = pieces[reverse_color(color)];
+  Bitboard pinned = 0;
+
+  // enemy sliders that would see the king on an empty board
+  Bitboard snipers = (rook_attacks(king_sq, 0) & (enemy[Piece::ROOK] | enemy[Piece::QUEEN]))
+    | (bishop_attacks(king_sq, 0) & (enemy[Piece::BISHOP] | enemy[Piece::QUEEN]));
+  while (snipers) {
+    Bitboard blockers = between_bb[king_sq][pop_lsb(snipers)] & all;
+    if (popcount(blockers) == 1 && (blockers & occupied[color]))
+      pinned |= blockers;
   }
 
-  // check if a bishop / queen checks the square
-  for (int dist = 1; dist + x <= 8 && dist + y <= 8; ++dist) {
-    if (board[dist + x][dist + y] != nullptr) {
-      if (board[dist + x][dist + y]->get_color() != color && 
-        (board[dist + x][dist + y]->get_type() == Piece::BISHOP || board[dist + x][dist + y]->get_type() == Piece::QUEEN))
-        return true;
-      break;
-    }
+  return pinned;
+}
+
+void GameState::exec_move(PackedMove move) {
+  StateInfo &st = history[ply++];
+  st.castling = castling;
+  st.ep_square = ep_square;
+  st.key = key;
+  if (ep_square != NO_SQUARE) {
+    key ^= ep_key(ep_square);
+    ep_square = NO_SQUARE;
   }
 
-  for (int dist = 1; -dist + x >= 1 && dist + y <= 8; ++dist) {
-    if (board[-dist + x][dist + y] != nullptr) {
-      if (board[-dist + x][dist + y]->get_color() != color && 
-        (board[-dist + x][dist + y]->get_type() == Piece::BISHOP || board[-dist + x][dist + y]->get_type() == Piece::QUEEN))
-        return true;
-      break;
-    }
+  int x2 = square_x(move_to(move)), y2 = square_y(move_to(move));
+
+  if (move_kind(move) == MOVE_DROP) {
+    Piece p = move_drop(move);
+    remove_from_hand(color, p);
+    put_piece(x2, y2, make_piece(p, color));
+    check_key();
+    return;
   }
 
-  for (int dist = 1; dist + x <= 8 && -dist + y >= 1; ++dist) {
-    if (board[dist + x][-dist + y] != nullptr) {
-      if (board[dist + x][-dist + y]->get_color() != color &&
-        (board[dist + x][-dist + y]->get_type() == Piece::BISHOP || board[dist + x][-dist + y]->get_type() == Piece::QUEEN))
-        return true;
-      break;
+  int x = square_x(move_from(move)), y = square_y(move_from(move));
+  castling &= ~(castling_lost(move_from(move)) | castling_lost(move_to(move)));
+  key ^= zobrist.castling[st.castling] ^ zobrist.castling[castling];
+
+  if (move_kind(move) == MOVE_CASTLE) {
+    if (x2 == 7) {
+      // e - g -> rocada mica
+      move_piece(5, y, 7, y);
+      move_piece(8, y, 6, y);
+    } else {
+      // e - a -> rocada mare
+      move_piece(5, y, 3, y);
+      move_piece(1, y, 4, y);
     }
+    check_key();
+    return;
   }
 
-  for (int dist = 1; -dist + x >= 1 && -dist + y >= 1; ++dist) {
-    if (board[-dist + x][-dist + y] != nullptr) {
-      if (board[-dist + x][-dist + y]->get_color() != color &&
-        (board[-dist + x][-dist + y]->get_type() == Piece::BISHOP || board[-dist + x][-dist + y]->get_type() == Piece::QUEEN))
-        return true;
-      break;
+  st.moved = board[x][y];
+  st.captured = board[x2][y2];
+  st.en_passant = false;
+  if (st.captured != NO_PIECE) {
+    remove_piece(x2, y2);
+    add_to_hand(color, hand_type(st.captured));
+  } else if (x != x2 && piece_type(st.moved) == Piece::PAWN) {
+    // en passant
+    st.en_passant = true;
+    if (y2 == 6)
+      st.captured = remove_piece(x2, 5);
+    else
+      st.captured = remove_piece(x2, 4);
+    add_to_hand(color, Piece::PAWN);
+  } else if (piece_type(st.moved) == Piece::PAWN && (y2 - y == 2 || y - y2 == 2)) {
+    int passed = make_square(x, (y + y2) / 2);
+    if (pawn_attacks[color][passed] & pieces[reverse_color(color)][Piece::PAWN]) {
+      ep_square = passed;
+      key ^= ep_key(passed);
     }
   }
- 
-  // check if a knight checks the square
-  for (int i = 0; i < 8; ++i) {
-    if (knight_dx[i] + x >= 1 && knight_dx[i] + x <= 8 && knight_dy[i] + y >= 1 && knight_dy[i] + y <= 8
-        && board[knight_dx[i] + x][knight_dy[i] + y] != nullptr 
-        && board[knight_dx[i] + x][knight_dy[i] + y]->get_color() != color 
-        && board[knight_dx[i] + x][knight_dy[i] + y]->get_type() == Piece::KNIGHT)
-      return true;
-  }
 
-  // check if the enemy king checks the square
-  for (int i = 0; i < 8; ++i) {
-    if (x + king_dx[i] >= 1 && x + king_dx[i] <= BOARD_SIZE && y + king_dy[i] >= 1 && y + king_dy[i] <= BOARD_SIZE 
-        && board[x + king_dx[i]][y + king_dy[i]] != nullptr 
-        && board[x + king_dx[i]][y + king_dy[i]]->get_color() != color
-        && board[x + king_dx[i]][y + king_dy[i]]->get_type() == Piece::KING)
-      return true;
+  if (move_kind(move) == MOVE_PROMOTION) {
+    remove_piece(x, y);
+    put_piece(x2, y2, make_piece(move_promotion(move), color, PROMOTED_FLAG));
+  } else {
+    move_piece(x, y, x2, y2);
   }
-
-  // check if a pawn checks the square
-  int pawn_dy = (color == PlaySide::WHITE) ? 1 : -1; 
-  if (x + 1 <= 8 && y + pawn_dy >= 1 && y + pawn_dy <= 8
-      && board[x + 1][y + pawn_dy] != nullptr
-      && board[x + 1][y + pawn_dy]->get_color() != color && board[x + 1][y + pawn_dy]->get_type() == Piece::PAWN)
-    return true;
-
-  if (x - 1 >= 1 && y + pawn_dy >= 1 && y + pawn_dy <= 8
-      && board[x - 1][y + pawn_dy] != nullptr
-      && board[x - 1][y + pawn_dy]->get_color() != color && board[x - 1][y + pawn_dy]->get_type() == Piece::PAWN)
-    return true;
-
-  return false;
+  check_key();
 }
 
-bool GameState::king_check(int x, int y) {
-  return square_check(x, y);
+void GameState::check_key() {
+#ifdef CHESSBOT_DEBUG
+  assert(key == calc_key(*this));
+  assert(pawn_key == calc_pawn_key(*this));
+  assert(king_square[0] == lsb(pieces[0][Piece::KING]) && king_square[1] == lsb(pieces[1][Piece::KING]));
+  for (int sq = 0; sq < SQUARE_NB; ++sq) {
+    Bitboard from = attackers_to(sq, all);
+    for (int side = 0; side < 2; ++side) {
+      assert(attackers[side][sq] == popcount(from & occupied[side]));
+      for (int type = 0; type < 6; ++type) {
+        assert(attack_count[side][type][sq] == popcount(from & pieces[side][type]));
+        assert(((attacked_by[side][type] >> sq) & 1) == (attack_count[side][type][sq] > 0));
+      }
+    }
+  }
+#endif
 }
 
-bool same_vision(std::pair<int, int> p, std::pair<int, int> p2) {
-  return (p.first == p2.first) 
-    || (p.second == p2.second) 
-    || (p.first + p.second == p2.first + p2.second) 
-    || (p.first - p.second == p2.first - p2.second);
+void GameState::exec_null_move() {
+  StateInfo &st = history[ply++];
+  st.ep_square = ep_square;
+  st.key = key;
+  if (ep_square != NO_SQUARE) {
+    key ^= ep_key(ep_square);
+    ep_square = NO_SQUARE;
+  }
 }
 
-bool horse_vision(std::pair<int, int> p, std::pair<int, int> p2) {
-  return (abs(p.first - p2.first) == 2 && abs(p.second - p2.second) == 1)
-    || (abs(p.first - p2.first) == 1 && abs(p.second - p2.second) == 2);
+void GameState::undo_null_move() {
+  StateInfo &st = history[--ply];
+  ep_square = st.ep_square;
+  key = st.key;
 }
 
-bool GameState::check_move(std::pair<int, int> king_position, bool king_checked, MoveImpl* move) {
-  if (!king_checked) {
-    auto start = move->get_start();
-    if (start.first < 0)
-      return true;
-    if (!same_vision(king_position, start))
-      return true;
-  } else {
-    auto end = move->get_end();
-    if (!same_vision(king_position, end) && !horse_vision(king_position, end))
-      return false;
+void GameState::undo_move(PackedMove move) {
+  StateInfo &st = history[--ply];
+  castling = st.castling;
+  ep_square = st.ep_square;
+  // the board writes below change the key, it is taken back from st once they are done
+
+  int x2 = square_x(move_to(move)), y2 = square_y(move_to(move));
+
+  if (move_kind(move) == MOVE_DROP) {
+    add_to_hand(color, move_drop(move));
+    remove_piece(x2, y2);
+    key = st.key;
+    return;
+  }
+
+  int x = square_x(move_from(move)), y = square_y(move_from(move));
+
+  if (move_kind(move) == MOVE_CASTLE) {
+    if (x2 == 7) {
+      // e - g -> rocada mica
+      move_piece(7, y, 5, y);
+      move_piece(6, y, 8, y);
+    } else {
+      // e - a -> rocada mare
+      move_piece(3, y, 5, y);
+      move_piece(4, y, 1, y);
+    }
+    key = st.key;
+    return;
   }
 
-  auto end = move->get_end();
-  move->exec_move(*this);
-  if (board[end.first][end.second] != nullptr && board[end.first][end.second]->get_type() == Piece::KING
-      && board[end.first][end.second]->get_color() == color)
-    king_position = end;
-  bool ret = king_check(king_position.first, king_position.second);
-  move->undo_move(*this);
-  return !ret;
+  remove_piece(x2, y2);
+  put_piece(x, y, st.moved);
+
+  if (st.captured != NO_PIECE) {
+    remove_from_hand(color, hand_type(st.captured));
+    if (!st.en_passant)
+      put_piece(x2, y2, st.captured);
+    else if (y2 == 6)
+      put_piece(x2, 5, st.captured);
+    else
+      put_piece(x2, 4, st.captured);
+  }
+  key = st.key;
 }
 
 void GameState::print_board() {
   std::cerr << std::endl;
   for (int j = 1; j <= BOARD_SIZE; ++j) {
     for (int i = BOARD_SIZE; i >= 1; --i) {
-      if (board[i][j] == nullptr)
+      if (board[i][j] == NO_PIECE)
         std::cerr << '_';
       else {
         char ch;
-        if (board[i][j]->get_type() == Piece::PAWN)
+        if (piece_type(board[i][j]) == Piece::PAWN)
           ch = 'p';
-        else if (board[i][j]->get_type() == Piece::QUEEN)
+        else if (piece_type(board[i][j]) == Piece::QUEEN)
           ch = 'q';
-        else if (board[i][j]->get_type() == Piece::KNIGHT)
+        else if (piece_type(board[i][j]) == Piece::KNIGHT)
           ch = 'n';
-        else if (board[i][j]->get_type() == Piece::BISHOP)
+        else if (piece_type(board[i][j]) == Piece::BISHOP)
           ch = 'b';
-        else if (board[i][j]->get_type() == Piece::ROOK)
+        else if (piece_type(board[i][j]) == Piece::ROOK)
           ch = 'r';
         else
           ch = 'k';
-        if (board[i][j]->get_color() == PlaySide::BLACK)
+        if (piece_color(board[i][j]) == PlaySide::BLACK)
           ch = ch - 'a' + 'A';
         std::cerr << ch;
       }
@@ -222,179 +397,255 @@ void GameState::print_board() {
   }
 }
 
-std::vector<MoveImpl*> GameState::get_moves() {
-  std::vector<MoveImpl*> moves;
+template <PlaySide Us>
+Bitboard GameState::legal_targets(int sq, int king_sq, Bitboard checkers, Bitboard pinned) {
+  constexpr PlaySide them = (Us == PlaySide::WHITE) ? PlaySide::BLACK : PlaySide::WHITE;
+
+  if (sq == king_sq) {
+    // the attack maps stop at the king, the squares behind it on the line of a checking slider are not safe either
+    Bitboard targets = king_attacks[king_sq] & ~occupied[Us] & ~attacked_squares(them);
+    Bitboard sliders = checkers & ~(pieces[them][Piece::PAWN] | pieces[them][Piece::KNIGHT]);
+    while (sliders) {
+      int checker = pop_lsb(sliders);
+      targets &= ~line_bb[king_sq][checker] | square_bb(checker);
+    }
+    return targets;
+  }
 
-  std::pair<int, int> king_position = king_pos(color);
+  // in double check only the king can move
+  if (popcount(checkers) > 1)
+    return 0;
 
-  for (int i = 1; i <= BOARD_SIZE; ++i) {
-    bool found = false;
-    for (int j = 1; j <= BOARD_SIZE; ++j) {
-      if (board[i][j] != nullptr && board[i][j]->get_type() == Piece::KING && board[i][j]->get_color() == color) {
-        king_position = {i, j};
-        found = true;
-        break;
-      }
-    }
-    if (found)
-      break;
+  Bitboard targets = piece_vision<Us>(piece_type(board[square_x(sq)][square_y(sq)]), sq, occupied[Us], occupied[them]);
+  // in check every other move has to capture the checker or block it
+  if (checkers)
+    targets &= between_bb[king_sq][lsb(checkers)] | checkers;
+  // a pinned piece can only move along the pin
+  if (pinned & square_bb(sq))
+    targets &= line_bb[king_sq][sq];
+
+  return targets;
+}
+
+bool GameState::is_legal(PackedMove move) {
+  if (color == PlaySide::WHITE)
+    return legal<PlaySide::WHITE>(move);
+  return legal<PlaySide::BLACK>(move);
+}
+
+template <PlaySide Us>
+bool GameState::legal(PackedMove move) {
+  constexpr PlaySide them = (Us == PlaySide::WHITE) ? PlaySide::BLACK : PlaySide::WHITE;
+  // only the promotions use the promotion bits
+  if (move == MOVE_NONE || (move_kind(move) != MOVE_PROMOTION && move_promotion(move) != Piece::ROOK))
+    return false;
+
+  int king_sq = king_square[Us];
+  Bitboard checkers = attackers[them][king_sq] ? attackers_to(king_sq, all) & occupied[them] : 0;
+  int to = move_to(move);
+
+  if (move_kind(move) == MOVE_DROP) {
+    Piece type = move_drop(move);
+    if (type >= Piece::KING || (all & square_bb(to)) || popcount(checkers) > 1)
+      return false;
+    if (type == Piece::PAWN && !(PAWN_DROP_MASK & square_bb(to)))
+      return false;
+    // when in check a drop can only block
+    if (checkers && !(between_bb[king_sq][lsb(checkers)] & square_bb(to)))
+      return false;
+    return hand[Us][type] > 0;
+  }
+
+  // castling is checked against its own generator, which only looks at the back rank
+  if (move_kind(move) == MOVE_CASTLE) {
+    MoveList castles;
+    get_castles<Us>(castles);
+    return std::find(castles.begin(), castles.end(), move) != castles.end();
+  }
+
+  int from = move_from(move);
+  if (!(occupied[Us] & square_bb(from)))
+    return false;
+
+  bool promotion = piece_type(board[square_x(from)][square_y(from)]) == Piece::PAWN
+    && (square_bb(to) & relative_rank<Us>(RANK_8));
+  if (promotion != (move_kind(move) == MOVE_PROMOTION))
+    return false;
+  if (promotion && move_promotion(move) != Piece::QUEEN)
+    return false;
+
+  return legal_targets<Us>(from, king_sq, checkers, pinned_pieces(king_sq)) & square_bb(to);
+}
+
+bool GameState::has_legal_move() {
+  if (color == PlaySide::WHITE)
+    return any_legal_move<PlaySide::WHITE>();
+  return any_legal_move<PlaySide::BLACK>();
+}
+
+template <PlaySide Us>
+bool GameState::any_legal_move() {
+  constexpr PlaySide them = (Us == PlaySide::WHITE) ? PlaySide::BLACK : PlaySide::WHITE;
+  int king_sq = king_square[Us];
+  Bitboard checkers = attackers[them][king_sq] ? attackers_to(king_sq, all) & occupied[them] : 0;
+
+  // the king and the drops almost always have a move, castling never is the only one
+  if (legal_targets<Us>(king_sq, king_sq, checkers, 0))
+    return true;
+  if (popcount(checkers) > 1)
+    return false;
+
+  Bitboard target = checkers ? between_bb[king_sq][lsb(checkers)] : ~all;
+  if (target) {
+    if (hand[Us][Piece::PAWN] && (target & PAWN_DROP_MASK))
+      return true;
+    for (int i = Piece::ROOK; i < Piece::KING; ++i)
+      if (hand[Us][i])
+        return true;
   }
 
-  bool king_checked = king_check(king_position.first, king_position.second);
+  Bitboard pinned = pinned_pieces(king_sq);
+  Bitboard own = occupied[Us] ^ square_bb(king_sq);
+  while (own)
+    if (legal_targets<Us>(pop_lsb(own), king_sq, checkers, pinned))
+      return true;
+  return false;
+}
+
+void GameState::get_moves(MoveList &moves, GenType type) {
+  if (color == PlaySide::WHITE)
+    generate<PlaySide::WHITE>(moves, type);
+  else
+    generate<PlaySide::BLACK>(moves, type);
+}
+
+template <PlaySide Us>
+void GameState::generate(MoveList &moves, GenType type) {
+  constexpr PlaySide them = (Us == PlaySide::WHITE) ? PlaySide::BLACK : PlaySide::WHITE;
+  int king_sq = king_square[Us];
+  Bitboard checkers = attackers[them][king_sq] ? attackers_to(king_sq, all) & occupied[them] : 0;
+  Bitboard pinned = pinned_pieces(king_sq);
+
  // print_board();
-  for (int i = 1; i <= BOARD_SIZE; ++i) {
-    for (int j = 1; j <= BOARD_SIZE; ++j) {
-      if (board[i][j] != nullptr && board[i][j]->get_color() == color) {
-        auto piece_vision = board[i][j]->get_vision(*this, i, j);
-
-        for (const auto &it : piece_vision) {
-          MoveImpl* move;
-          if ((it.second == 1 || it.second == 8) && board[i][j]->get_type() == Piece::PAWN) {
-            /**
-            move = new MovePromotion(i, j, it.first, it.second, Piece::KNIGHT);
-            if (check_move(king_position, king_checked, move))
-              moves.push_back(move);
-            else
-              delete move;
-            **/
-            move = new MovePromotion(i, j, it.first, it.second, Piece::QUEEN);
-            if (check_move(king_position, king_checked, move))
-              moves.push_back(move);
-            else
-              delete move;
-            /**
-            move = new MovePromotion(i, j, it.first, it.second, Piece::ROOK);
-            if (check_move(king_position, king_checked, move))
-              moves.push_back(move);
-            else
-              delete move;
-            move = new MovePromotion(i, j, it.first, it.second, Piece::BISHOP);
-            if (check_move(king_position, king_checked, move))
-              moves.push_back(move);
-            else
-              delete move;
-            **/
-          } else {
-            move = new MovePiece(i, j, it.first, it.second);
-            if (check_move(king_position, king_checked, move))
-              moves.push_back(move);
-            else
-              delete move;
-          }
+  if (type != GEN_DROPS) {
+    Bitboard own = occupied[Us];
+    while (own) {
+      int sq = pop_lsb(own);
+      int i = square_x(sq), j = square_y(sq);
+      // pawn moves to the last rank are promotions, which are grouped with the captures
+      Bitboard promotion = (piece_type(board[i][j]) == Piece::PAWN) ? relative_rank<Us>(RANK_8) : 0;
+      Bitboard piece_vision = legal_targets<Us>(sq, king_sq, checkers, pinned);
+      if (type == GEN_CAPTURES)
+        piece_vision &= occupied[them] | promotion;
+      else if (type == GEN_QUIETS)
+        piece_vision &= ~(occupied[them] | promotion);
+
+      while (piece_vision) {
+        int to = pop_lsb(piece_vision);
+        if (promotion & square_bb(to)) {
+          // moves.push_back(make_promotion(sq, to, Piece::KNIGHT));
+          moves.push_back(make_promotion(sq, to, Piece::QUEEN));
+          // moves.push_back(make_promotion(sq, to, Piece::ROOK));
+          // moves.push_back(make_promotion(sq, to, Piece::BISHOP));
+        } else {
+          moves.push_back(make_move(sq, to));
         }
       }
     }
   }
 
-  // en passant
-  /**
-  int passant_x = en_passant_opportunity[color];
-  if (passant_x && 1 == 0) {
-    int y = (color == PlaySide::WHITE) ? 5 : 4;
-    int dy = (color == PlaySide::WHITE) ? 1 : -1;
-    if (passant_x - 1 >= 1 && board[passant_x - 1][y] != nullptr 
-        && board[passant_x - 1][y]->get_type() == Piece::PAWN
-        && board[passant_x - 1][y]->get_color() == color) {
-      moves.push_back(new MovePiece(passant_x - 1, y, passant_x, y + dy));
+  if (type == GEN_QUIETS || type == GEN_ALL) {
+    // en passant
+    /**
+    if (ep_square != NO_SQUARE) {
+      Bitboard capturers = pawn_attacks[them][ep_square] & pieces[Us][Piece::PAWN];
+      while (capturers)
+        moves.push_back(make_move(pop_lsb(capturers), ep_square));
     }
+    **/
 
-    if (passant_x + 1 <= 8 && board[passant_x + 1][y] != nullptr 
-        && board[passant_x + 1][y]->get_type() == Piece::PAWN
-        && board[passant_x + 1][y]->get_color() == color) {
-      moves.push_back(new MovePiece(passant_x + 1, y, passant_x, y + dy));
-    }
+    get_castles<Us>(moves);
   }
-  **/
 
+  if (type == GEN_DROPS || type == GEN_ALL)
+    get_drops<Us>(moves, king_sq, checkers);
+}
+
+template <PlaySide Us>
+void GameState::get_castles(MoveList &moves) {
   // castle
-  int y = (color == PlaySide::WHITE) ? 1 : 8;
+  constexpr int y = (Us == PlaySide::WHITE) ? 1 : 8;
 
-  if (board[5][y] != nullptr && board[5][y]->get_type() == Piece::KING && board[5][y]->get_first_move() == true
-      && !square_check(5, y)) {
-    if (board[6][y] == nullptr && board[7][y] == nullptr && board[8][y] != nullptr && board[8][y]->get_type() == Piece::ROOK && board[8][y]->get_first_move() == true) {
-      if (!square_check(6, y) && !square_check(7, y)) {
-        MoveImpl* move = new MoveCastle(7, y);
-        moves.push_back(move);
-      }
+  constexpr int oo = (Us == PlaySide::WHITE) ? WHITE_OO : BLACK_OO;
+  constexpr int ooo = (Us == PlaySide::WHITE) ? WHITE_OOO : BLACK_OOO;
+  const uint8_t *enemy_attacks = attackers[(Us == PlaySide::WHITE) ? PlaySide::BLACK : PlaySide::WHITE];
+
+  if ((castling & (oo | ooo)) && !enemy_attacks[make_square(5, y)]) {
+    if ((castling & oo) && board[6][y] == NO_PIECE && board[7][y] == NO_PIECE) {
+      if (!enemy_attacks[make_square(6, y)] && !enemy_attacks[make_square(7, y)])
+        moves.push_back(make_move(make_square(5, y), make_square(7, y), MOVE_CASTLE));
     }
 
     /**
-    if (board[2][y] == nullptr && board[3][y] == nullptr && board[4][y] == nullptr && board[1][y] != nullptr && board[1][y]->get_type() == Piece::ROOK && board[1][y]->get_first_move() == true) {
-      MoveImpl* move = new MoveCastle(3, y);
-      if (!square_check(4, y) && !square_check(3, y)) {
-        for (auto it : moves)
-          delete it;
-        moves.clear();
+    if ((castling & ooo) && board[2][y] == NO_PIECE && board[3][y] == NO_PIECE && board[4][y] == NO_PIECE) {
+      PackedMove move = make_move(make_square(5, y), make_square(3, y), MOVE_CASTLE);
+      if (!enemy_attacks[make_square(4, y)] && !enemy_attacks[make_square(3, y)]) {
+        moves.size = 0;
         moves.push_back(move);
-        return moves;
-      } else
-        delete move;
+        return;
+      }
     }
     **/
   }
+}
 
-  // drop in
-  bool f[6];
-  for (int i = 0; i < 6; ++i)
-    f[i] = 0;
-  for (auto it : bag[color]) {
-    Piece type = it->get_type();
-    if (f[type])
-      continue;
+template <PlaySide Us>
+void GameState::get_drops(MoveList &moves, int king_sq, Bitboard checkers) {
+  // in double check only the king can move
+  if (popcount(checkers) > 1)
+    return;
 
-    f[type] = 1;
-    int mn = 1 + (type == Piece::PAWN);
-    int mx = 8 - (type == Piece::PAWN);
-
-    for (int i = 1; i <= 8; ++i) {
-      for (int j = mn; j <= mx; ++j) {
-        if (board[i][j] == nullptr) {
-          MoveImpl* move = new MoveDropIn(type, i, j);
-          if (check_move(king_position, king_checked, move))
-            moves.push_back(move);
-          else
-            delete move;
-        }
-      }
-    }
-  }
+  // when in check a drop can only block
+  Bitboard target = ~0ULL;
+  if (checkers)
+    target = between_bb[king_sq][lsb(checkers)];
 
-  return moves;
-}
+  for (int i = 0; i < 6; ++i) {
+    if (hand[Us][i] == 0)
+      continue;
 
-void GameState::check_en_passant(Move *move) {
-  int x, y, x2, y2;
-  std::tie(x, y) = string_to_position(move->getSource().value());
-  if (board[x][y]->get_type() != Piece::PAWN)
-    return;
+    Piece type = (Piece)i;
+    Bitboard targets = ~all & target;
+    if (type == Piece::PAWN)
+      targets &= PAWN_DROP_MASK;
 
-  std::tie(x2, y2) = string_to_position(move->getDestination().value());
-  if (y - y2 == 2 || y - y2 == -2)
-    en_passant_opportunity[reverse_color(color)] = x;
+    while (targets) {
+      int sq = pop_lsb(targets);
+      moves.push_back(make_drop(type, sq));
+    }
+  }
 }
 
 void GameState::record_move(Move* move, PlaySide color) {
   this->color = color;
-  en_passant_opportunity[reverse_color(color)] = 0;
-  MoveImpl *tmp = nullptr;
+  PackedMove tmp = MOVE_NONE;
   if (move->isNormal()) {
     tmp = generate_normal(*this, move);
-    check_en_passant(move);
   } else if (move->isPromotion()) {
     tmp = generate_promotion(*this, move);
   } else if (move->isDropIn()) {
     tmp = generate_drop(*this, move);
   }
-  tmp->exec_move(*this);
+  exec_move(tmp);
+  // moves played on the board are never taken back
+  ply = 0;
 }
 
 Move* GameState::do_move(PlaySide color) {
   this->color = color;
 
-  MoveImpl *move = find_move(*this);
-  move->exec_move(*this);
-  Move* ret = move->to_engine(); 
-
-  delete move;
-  return ret;
+  PackedMove move = find_move(*this);
+  exec_move(move);
+  ply = 0;
+  return to_engine(move);
 }
@@ -1,7 +1,9 @@
 #ifndef CHESSBOT_GAMESTATE_HPP
 #define CHESSBOT_GAMESTATE_HPP
 #include <algorithm>
+#include <type_traits>
 #include <utility>
+#include "bitboard.h"
 #include "pieces.h"
 #include "PlaySide.h"
 #include "Move.h"
@@ -13,22 +15,120 @@ inline PlaySide reverse_color(const PlaySide color) {
   return (color == PlaySide::BLACK) ? PlaySide::WHITE : PlaySide::BLACK;
 }
 
-class GameState {
+// deepest line the search can play on the state
+constexpr int MAX_PLY = 128;
+
+// the groups of moves get_moves can generate, promotions are grouped with the captures
+enum GenType { GEN_ALL, GEN_CAPTURES, GEN_QUIETS, GEN_DROPS };
+
+// castling rights, one bit per side and wing
+constexpr int WHITE_OO = 1;
+constexpr int WHITE_OOO = 2;
+constexpr int BLACK_OO = 4;
+constexpr int BLACK_OOO = 8;
+
+constexpr int NO_SQUARE = -1;
+
+/**
+ * Everything that describes a position, as plain data so that a position
+ * can be saved and restored with a memcpy.
+ */
+struct Position {
+  PieceCode board[BOARD_SIZE + 1][BOARD_SIZE + 1];
+  Bitboard pieces[2][6];
+  Bitboard occupied[2];
+  Bitboard all;
+  // the bitboards above are the piece lists, the king squares are cached on top of them
+  int8_t king_square[2];
+  // pieces in hand, counted per type
+  uint8_t hand[2][6];
+  PlaySide color;
+  // castling rights still available, see WHITE_OO
+  uint8_t castling;
+  // square behind a pawn that just moved two squares, only if an enemy pawn can take it
+  int8_t ep_square;
+  // Zobrist key of the board and hands, GameState::hash adds the side to move
+  int64_t key;
+  // Zobrist key of the pawns alone, for the pawn hash table
+  int64_t pawn_key;
+
+  // attack maps, derived from the board and kept up to date by the board write primitives
+  // squares attacked by the piece on each square, own pieces included
+  Bitboard attacks_from[SQUARE_NB];
+  // squares attacked by at least one piece of the color and type
+  Bitboard attacked_by[2][6];
+  // number of pieces of each color attacking a square
+  uint8_t attackers[2][SQUARE_NB];
+  // the same count split by the type of the attacker
+  uint8_t attack_count[2][6][SQUARE_NB];
+};
+
+static_assert(std::is_trivially_copyable<Position>::value, "Position must stay plain data");
+
+// what exec_move has to remember so undo_move can restore the position
+struct StateInfo {
+  PieceCode moved;
+  PieceCode captured;
+  bool en_passant;
+  uint8_t castling;
+  int8_t ep_square;
+  int64_t key;
+};
+
+class GameState : public Position {
 public:
   GameState();
-  std::vector<MoveImpl*> get_moves();
+  void get_moves(MoveList &moves, GenType type = GEN_ALL);
+  // true if the move is legal here, for moves remembered from other positions
+  bool is_legal(PackedMove move);
+  // true if the side to move has any legal move, stops at the first one found
+  bool has_legal_move();
+  void exec_move(PackedMove move);
+  void undo_move(PackedMove move);
+  // passes the turn for the null move search, the caller flips color like after exec_move
+  void exec_null_move();
+  void undo_null_move();
   Move* do_move(PlaySide color);
   void record_move(Move* move, PlaySide color);
   bool square_check(int i, int j);
   bool king_check(int x, int y);
-  std::pair<int, int> king_pos(PlaySide king_color);
-  bool check_move(std::pair<int, int> king_position, bool king_checked, MoveImpl* move);
+  // the side to move is in check
+  bool in_check() const;
+  Bitboard attackers_to(int sq, Bitboard occupancy) const;
+  // squares attacked by the color, with or without its king
+  Bitboard attacked_squares(PlaySide side, bool with_king = true) const;
+  // own pieces that are the only blocker between the king and an enemy slider
+  Bitboard pinned_pieces(int king_sq) const;
+  // the generator and legality test for the side Us, get_moves and is_legal pick the side once
+  template <PlaySide Us> void generate(MoveList &moves, GenType type);
+  template <PlaySide Us> bool legal(PackedMove move);
+  template <PlaySide Us> bool any_legal_move();
+  // squares the own piece on sq can legally move to
+  template <PlaySide Us> Bitboard legal_targets(int sq, int king_sq, Bitboard checkers, Bitboard pinned);
   void print_board();
-  void check_en_passant(Move *move);
+  template <PlaySide Us> void get_castles(MoveList &moves);
+  template <PlaySide Us> void get_drops(MoveList &moves, int king_sq, Bitboard checkers);
 
-  PlaySide color;
-  PieceImpl* board[BOARD_SIZE + 1][BOARD_SIZE + 1];
-  std::vector<PieceImpl*> bag[2];
+  // every board write goes through these so the bitboards and the key stay in sync with board
+  void put_piece(int x, int y, PieceCode piece);
+  PieceCode remove_piece(int x, int y);
+  void move_piece(int x, int y, int new_x, int new_y);
+  void add_to_hand(PlaySide side, Piece type);
+  void remove_from_hand(PlaySide side, Piece type);
+  // adds the attacks of the piece on sq to the attack maps, or takes them out again
+  void add_attacks(int sq);
+  void remove_attacks(int sq);
+  // sliders whose rays end on sq, their attacks change when sq is filled or emptied
+  Bitboard sliders_to(int sq) const;
+  // compares the incremental key, king squares and attack maps with a full recomputation in debug builds
+  void check_key();
+  // the type a captured piece has in hand, promoted pieces go back as pawns
+  static Piece hand_type(PieceCode piece);
+  // key of the position with the side to move, for the transposition table
+  int64_t hash() const;
+
+  StateInfo history[MAX_PLY];
+  int ply;
 };
 
 #endif // CHESSBOT_GAMESTATE_HPP
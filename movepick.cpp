@@ -0,0 +1,143 @@
+#include "movepick.h"
+
+// rough piece values used only to order captures, indexed by Piece
+static const int order_value[6] = {1, 5, 3, 3, 9, 0};
+
+bool is_quiet(const GameState &state, PackedMove move) {
+  if (move_kind(move) == MOVE_DROP || move_kind(move) == MOVE_CASTLE)
+    return true;
+  if (move_kind(move) == MOVE_PROMOTION)
+    return false;
+  return !(state.all & square_bb(move_to(move)));
+}
+
+MovePicker::MovePicker(GameState &state, PackedMove tt_move, const PackedMove *killers, bool captures_only)
+  : state(state), tt_move(tt_move), stage(STAGE_TT), captures_only(captures_only), current(0), killer_index(0),
+    bad_begin(0), bad_end(0) {
+  this->killers[0] = killers ? killers[0] : MOVE_NONE;
+  this->killers[1] = killers ? killers[1] : MOVE_NONE;
+}
+
+bool MovePicker::returned_before(PackedMove move) const {
+  // a killer that is legal here was already returned by the killer stage
+  return move == tt_move || move == killers[0] || move == killers[1];
+}
+
+void MovePicker::score_captures() {
+  PlaySide them = reverse_color(state.color);
+
+  for (int i = 0; i < moves.size; ++i) {
+    PackedMove move = moves[i];
+    int from = move_from(move), to = move_to(move);
+    PieceCode victim = state.board[square_x(to)][square_y(to)];
+    int victim_value = victim ? order_value[piece_type(victim)] : 0;
+    int attacker_value = order_value[piece_type(state.board[square_x(from)][square_y(from)])];
+
+    if (move_kind(move) == MOVE_PROMOTION) {
+      scores[i] = 16 * (victim_value + order_value[Piece::QUEEN]);
+    } else if (victim_value >= attacker_value || !state.attackers[them][to]) {
+      // most valuable victim first, then least valuable attacker
+      scores[i] = 16 * victim_value - attacker_value;
+    } else {
+      // a defended piece taken by a more valuable one, negative so it lands with the bad captures
+      scores[i] = victim_value - attacker_value;
+    }
+  }
+}
+
+void MovePicker::select_best(int end) {
+  int best = current;
+  for (int i = current + 1; i < end; ++i)
+    if (scores[i] > scores[best])
+      best = i;
+
+  std::swap(moves[current], moves[best]);
+  std::swap(scores[current], scores[best]);
+}
+
+PackedMove MovePicker::next_move() {
+  while (true) {
+    switch (stage) {
+      case STAGE_TT:
+        ++stage;
+        if (tt_move != MOVE_NONE && state.is_legal(tt_move))
+          return tt_move;
+        tt_move = MOVE_NONE;
+        break;
+
+      case STAGE_INIT_CAPTURES:
+        state.get_moves(moves, GEN_CAPTURES);
+        score_captures();
+        current = 0;
+        ++stage;
+        break;
+
+      case STAGE_GOOD_CAPTURES:
+        while (current < moves.size) {
+          select_best(moves.size);
+          if (scores[current] < 0)
+            break;
+          PackedMove move = moves[current++];
+          if (move != tt_move)
+            return move;
+        }
+        bad_begin = current;
+        bad_end = moves.size;
+        stage = captures_only ? STAGE_DONE : stage + 1;
+        break;
+
+      case STAGE_KILLERS:
+        while (killer_index < 2) {
+          PackedMove move = killers[killer_index++];
+          if (move != MOVE_NONE && move != tt_move && is_quiet(state, move) && state.is_legal(move))
+            return move;
+        }
+        ++stage;
+        break;
+
+      case STAGE_INIT_DROPS:
+        current = moves.size;
+        state.get_moves(moves, GEN_DROPS);
+        // heavier pieces first, the drops of one piece keep their order
+        std::stable_sort(moves.begin() + current, moves.end(), [](PackedMove a, PackedMove b) {
+            return order_value[move_drop(a)] > order_value[move_drop(b)];
+            });
+        ++stage;
+        break;
+
+      case STAGE_INIT_QUIETS:
+        current = moves.size;
+        state.get_moves(moves, GEN_QUIETS);
+        // castling is generated last, try it first
+        if (moves.size > current && move_kind(moves[moves.size - 1]) == MOVE_CASTLE)
+          std::rotate(moves.begin() + current, moves.end() - 1, moves.end());
+        ++stage;
+        break;
+
+      case STAGE_DROPS:
+      case STAGE_QUIETS:
+        while (current < moves.size) {
+          PackedMove move = moves[current++];
+          if (!returned_before(move))
+            return move;
+        }
+        if (stage == STAGE_QUIETS)
+          current = bad_begin;
+        ++stage;
+        break;
+
+      case STAGE_BAD_CAPTURES:
+        while (current < bad_end) {
+          select_best(bad_end);
+          PackedMove move = moves[current++];
+          if (move != tt_move)
+            return move;
+        }
+        ++stage;
+        break;
+
+      default:
+        return MOVE_NONE;
+    }
+  }
+}
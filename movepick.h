@@ -0,0 +1,46 @@
+#ifndef CHESSBOT_MOVEPICK_HPP
+#define CHESSBOT_MOVEPICK_HPP
+#include "gamestate.h"
+
+// captures and promotions are searched early anyway, everything else is quiet (drops included)
+bool is_quiet(const GameState &state, PackedMove move);
+
+/**
+ * Hands out the legal moves of a position one at a time, in stages:
+ * TT move, winning captures and promotions, killers, drops, quiet moves, losing captures.
+ * A stage is generated and scored only when the search asks for its first move,
+ * so a node that cuts off early never generates the long drop and quiet lists.
+ */
+class MovePicker {
+public:
+  // captures_only stops after the winning captures and promotions, for the quiescence search
+  MovePicker(GameState &state, PackedMove tt_move, const PackedMove *killers, bool captures_only = false);
+  // MOVE_NONE once every move was returned
+  PackedMove next_move();
+
+private:
+  enum Stage {
+    STAGE_TT, STAGE_INIT_CAPTURES, STAGE_GOOD_CAPTURES, STAGE_KILLERS,
+    STAGE_INIT_DROPS, STAGE_DROPS, STAGE_INIT_QUIETS, STAGE_QUIETS,
+    STAGE_BAD_CAPTURES, STAGE_DONE
+  };
+
+  // moves the earlier stages already returned
+  bool returned_before(PackedMove move) const;
+  void score_captures();
+  // moves the best scored move in [current, end) to current
+  void select_best(int end);
+
+  GameState &state;
+  PackedMove tt_move;
+  PackedMove killers[2];
+  int stage;
+  bool captures_only;
+  int current, killer_index;
+  // captures in [bad_begin, bad_end) lose material and are searched last
+  int bad_begin, bad_end;
+  MoveList moves;
+  int scores[MAX_MOVES];
+};
+
+#endif // CHESSBOT_MOVEPICK_HPP
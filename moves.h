@@ -1,9 +1,9 @@
 #ifndef CHESSBOT_MOVES_HPP
 #define CHESSBOT_MOVES_HPP
 
-#include <memory>
+#include <cstdint>
 #include "Move.h"
-#include "pieces.h"
+#include "Piece.h"
 
 class GameState;
 
@@ -14,76 +14,81 @@ class GameState;
 std::pair<int, int> string_to_position(std::string position);
 std::string serializeMove(Move* move);
 
-class MoveImpl {
-public:
-  virtual ~MoveImpl();
-  MoveImpl();
-  virtual Move* to_engine() = 0;
-  virtual void exec_move(GameState &state) = 0;
-  virtual void undo_move(GameState &state) = 0;
-  virtual std::pair<int,int> get_start() = 0;
-  virtual std::pair<int,int> get_end() = 0;
-  virtual bool is_castle();
-  virtual Piece get_drop();
-  virtual uint32_t get_hash(const GameState &state) = 0;
-};
+/**
+ * Moves used by the search are packed in 16 bits:
+ * bits 0-5   destination square
+ * bits 6-11  source square, or the dropped piece for drops
+ * bits 12-13 promotion piece, counted from ROOK
+ * bits 14-15 move kind
+ * Castles are stored as the king's move, like in the xboard protocol.
+ */
+typedef uint16_t PackedMove;
 
-class MovePiece : public MoveImpl {
-public:
-  MovePiece(int x, int y, int x2, int y2);
-  Move* to_engine() override;
-  void exec_move(GameState &state) override;
-  void undo_move(GameState &state) override;
-  std::pair<int,int> get_start() override;
-  std::pair<int,int> get_end() override;
-  uint32_t get_hash(const GameState &state) override;
-  int x, y, x2, y2;
-  PieceImpl *memento;
-  bool first_move, en_passant;
-};
+enum MoveKind { MOVE_NORMAL = 0, MOVE_CASTLE = 1, MOVE_PROMOTION = 2, MOVE_DROP = 3 };
 
-class MoveCastle : public MoveImpl {
-public:
-  MoveCastle(int x, int y);
-  Move* to_engine() override;
-  void exec_move(GameState &state) override;
-  void undo_move(GameState &state) override;
-  std::pair<int,int> get_start() override;
-  std::pair<int,int> get_end() override;
-  bool is_castle() override;
-  uint32_t get_hash(const GameState &state) override;
-  int x, y;
-};
+constexpr PackedMove MOVE_NONE = 0;
 
-class MovePromotion : public MovePiece {
-public:
-  MovePromotion(int x, int y, int x2, int y2, Piece p);
-  Move* to_engine() override;
-  void exec_move(GameState &state) override;
-  void undo_move(GameState &state) override;
-  uint32_t get_hash(const GameState &state) override;
-  PieceImpl *memento_prom;
-  Piece p;
-};
+constexpr PackedMove make_move(int from, int to, MoveKind kind = MOVE_NORMAL) {
+  return (PackedMove)(to | (from << 6) | (kind << 14));
+}
+
+constexpr PackedMove make_promotion(int from, int to, Piece p) {
+  return (PackedMove)(to | (from << 6) | ((p - Piece::ROOK) << 12) | (MOVE_PROMOTION << 14));
+}
+
+constexpr PackedMove make_drop(Piece p, int to) {
+  return (PackedMove)(to | (p << 6) | (MOVE_DROP << 14));
+}
+
+constexpr int move_to(PackedMove move) {
+  return move & 0x3F;
+}
+
+constexpr int move_from(PackedMove move) {
+  return (move >> 6) & 0x3F;
+}
+
+constexpr MoveKind move_kind(PackedMove move) {
+  return (MoveKind)(move >> 14);
+}
 
-class MoveDropIn : public MoveImpl {
-public:
-  MoveDropIn(Piece p, int x, int y);
-
-  Move* to_engine() override;
-  void exec_move(GameState &state) override;
-  void undo_move(GameState &state) override;
-  std::pair<int,int> get_start() override;
-  std::pair<int,int> get_end() override;
-  Piece get_drop() override;
-  uint32_t get_hash(const GameState &state) override;
-  Piece p;
-  int x, y;
-  int memento;
+constexpr Piece move_promotion(PackedMove move) {
+  return (Piece)(((move >> 12) & 3) + Piece::ROOK);
+}
+
+constexpr Piece move_drop(PackedMove move) {
+  return (Piece)((move >> 6) & 0x3F);
+}
+
+// upper bound for the legal moves of a crazyhouse position (promotions are queen only)
+constexpr int MAX_MOVES = 600;
+
+// fixed capacity move list living on the stack of the caller
+struct MoveList {
+  PackedMove moves[MAX_MOVES];
+  int size = 0;
+
+  void push_back(PackedMove move) {
+    moves[size++] = move;
+  }
+
+  PackedMove& operator[](int i) {
+    return moves[i];
+  }
+
+  PackedMove* begin() {
+    return moves;
+  }
+
+  PackedMove* end() {
+    return moves + size;
+  }
 };
 
-MoveImpl* generate_normal(GameState &state, Move *move);
-MoveImpl* generate_promotion(GameState &state, Move *move);
-MoveImpl* generate_drop(GameState &state, Move *move);
+Move* to_engine(PackedMove move);
+
+PackedMove generate_normal(GameState &state, Move *move);
+PackedMove generate_promotion(GameState &state, Move *move);
+PackedMove generate_drop(GameState &state, Move *move);
 
 #endif // CHESSBOT_MOVES_HPP
@@ -0,0 +1,87 @@
+#include "pawns.h"
+
+constexpr int DOUBLED_PAWN = 12;
+constexpr int ISOLATED_PAWN = 10;
+constexpr int SHELTER_PAWN = 8;
+// by rank counted from the own side, a pawn is dropped back anywhere so passers are worth less than in chess
+constexpr int PASSED_PAWN[8] = {0, 0, 5, 10, 18, 30, 50, 0};
+
+// one per thread, the searches never share it
+constexpr int pawn_table_size = 1 << 14;
+
+struct PawnEntry {
+  int64_t key;
+  // structure of both sides, white minus black
+  int structure;
+  int8_t king_square[2];
+  int shelter;
+};
+
+static thread_local PawnEntry pawn_table[pawn_table_size];
+
+static Bitboard adjacent_files(Bitboard files) {
+  return ((files & ~FILE_H) << 1) | ((files & ~FILE_A) >> 1);
+}
+
+// squares on the ranks in front of sq
+template <PlaySide Us>
+static Bitboard ranks_ahead(int sq) {
+  if constexpr (Us == PlaySide::WHITE)
+    return ~0ULL << (sq - (sq & 7) + 8);
+  else
+    return (1ULL << (sq & ~7)) - 1;
+}
+
+template <PlaySide Us>
+static int pawn_structure(const GameState &state) {
+  constexpr PlaySide Them = (Us == PlaySide::WHITE) ? PlaySide::BLACK : PlaySide::WHITE;
+  Bitboard own = state.pieces[Us][Piece::PAWN];
+  Bitboard enemy = state.pieces[Them][Piece::PAWN];
+  int score = 0;
+
+  for (int file = 0; file < 8; ++file) {
+    int count = popcount(own & (FILE_A << file));
+    if (count > 1)
+      score -= DOUBLED_PAWN * (count - 1);
+  }
+
+  Bitboard pawns = own;
+  while (pawns) {
+    int sq = pop_lsb(pawns);
+    Bitboard files = file_bb(sq) | adjacent_files(file_bb(sq));
+    if (!(own & adjacent_files(file_bb(sq))))
+      score -= ISOLATED_PAWN;
+    if (!(enemy & files & ranks_ahead<Us>(sq)))
+      score += PASSED_PAWN[(Us == PlaySide::WHITE) ? square_y(sq) - 1 : 8 - square_y(sq)];
+  }
+
+  return score;
+}
+
+// own pawns on the two ranks in front of the king, on its file and the adjacent ones
+template <PlaySide Us>
+static int king_shelter(const GameState &state, int king_sq) {
+  Bitboard files = file_bb(king_sq) | adjacent_files(file_bb(king_sq));
+  Bitboard ranks = pawn_push<Us>(rank_bb(king_sq)) | pawn_push<Us>(pawn_push<Us>(rank_bb(king_sq)));
+  return popcount(state.pieces[Us][Piece::PAWN] & files & ranks) * SHELTER_PAWN;
+}
+
+int evaluate_pawns(const GameState &state) {
+  PawnEntry &entry = pawn_table[(uint64_t)state.pawn_key & (pawn_table_size - 1)];
+  const int8_t *kings = state.king_square;
+
+  // an empty slot has key 0, which is also the key of no pawns at all and then the structure is 0 too
+  if (entry.key != state.pawn_key) {
+    entry.key = state.pawn_key;
+    entry.structure = pawn_structure<PlaySide::WHITE>(state) - pawn_structure<PlaySide::BLACK>(state);
+    entry.king_square[0] = entry.king_square[1] = -1;
+  }
+  if (entry.king_square[0] != kings[0] || entry.king_square[1] != kings[1]) {
+    entry.king_square[0] = kings[0];
+    entry.king_square[1] = kings[1];
+    entry.shelter = king_shelter<PlaySide::WHITE>(state, kings[PlaySide::WHITE])
+      - king_shelter<PlaySide::BLACK>(state, kings[PlaySide::BLACK]);
+  }
+
+  return entry.structure + entry.shelter;
+}
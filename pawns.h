@@ -0,0 +1,12 @@
+#ifndef CHESSBOT_PAWNS_HPP
+#define CHESSBOT_PAWNS_HPP
+#include "gamestate.h"
+
+/**
+ * Pawn structure and king shelter, white minus black. The structure only
+ * depends on the pawns, so it is cached by pawn_key; the shelter also depends
+ * on the kings and is recomputed when they moved.
+ */
+int evaluate_pawns(const GameState &state);
+
+#endif // CHESSBOT_PAWNS_HPP
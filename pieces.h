@@ -1,11 +1,10 @@
 #ifndef CHESSBOT_PIECES_HPP
 #define CHESSBOT_PIECES_HPP
-#include <vector>
-#include <memory>
+#include <cstdint>
+#include "bitboard.h"
 #include "PlaySide.h"
 #include "Piece.h"
 
-class GameState;
 /**
  * corner cases when moving a piece:
  * 1) pawn en passant
@@ -13,117 +12,68 @@ class GameState;
  * 3) king check
  */
 
-class PieceImpl {
-public:
-  virtual ~PieceImpl();
-  PieceImpl() = delete;
-  PieceImpl(PlaySide color);
-
-  virtual std::vector<std::pair<int, int>> get_vision(const GameState &state, int x, int y) = 0;
-
-  virtual void move_piece(GameState &state, int x, int y, int new_x, int new_y);
-  virtual bool is_king() const;
-  virtual void set_first_move(bool value);
-  virtual bool get_first_move() const;
-  virtual Piece get_type() const;
-
-  virtual PlaySide get_color() const;
-
-  bool is_promoted = false;
-  PlaySide color;
-};
-
-class Pawn : public PieceImpl {
-public:
-  Pawn(PlaySide color);
-
-  std::vector<std::pair<int, int>> get_vision(const GameState &state, int x, int y) final;
-
-  void move_piece(GameState &state, int x, int y, int new_x, int new_y) final;
-  void set_first_move(bool value) override;
-  bool get_first_move() const override;
-  Piece get_type() const override;
-
-protected:
-  bool first_move;
-};
-
-class Knight : public PieceImpl {
-public:
-  Knight() = delete;
-  Knight(PlaySide color);
-
-  std::vector<std::pair<int, int>> get_vision(const GameState &state, int x, int y) final;
-  Piece get_type() const override;
-};
-
-// It has to be virtual because queen inherits both rook and bishop
-class Bishop : virtual public PieceImpl {
-public:
-  Bishop() = delete;
-  Bishop(PlaySide color);
-
-  std::vector<std::pair<int, int>> get_vision(const GameState &state, int x, int y) override;
-  Piece get_type() const override;
-};
-
-// It has to be virtual because queen inherits both rook and bishop
-class Rook : virtual public PieceImpl {
-public:
-  Rook() = delete;
-  Rook(PlaySide color);
-
-  std::vector<std::pair<int, int>> get_vision(const GameState &state, int x, int y) override;
-
-  void move_piece(GameState &state, int x, int y, int new_x, int new_y) final;
-  void set_first_move(bool value) override;
-  bool get_first_move() const override;
-  Piece get_type() const override;
-
-protected:
-  bool first_move;
-};
+/**
+ * A piece on the board is a single byte:
+ * bits 0-2 the type plus one, so that 0 is an empty square
+ * bit 3    the color
+ * bit 4    set for promoted pieces, they go back to the hand as pawns
+ */
+typedef uint8_t PieceCode;
 
-class Queen : public Rook, public Bishop {
-public:
-  Queen(PlaySide color);
+constexpr PieceCode NO_PIECE = 0;
+constexpr PieceCode PROMOTED_FLAG = 1 << 4;
 
-  std::vector<std::pair<int, int>> get_vision(const GameState &state, int x, int y) override;
-  Piece get_type() const override;
-};
+constexpr PieceCode make_piece(Piece type, PlaySide color, PieceCode flags = 0) {
+  return (PieceCode)((type + 1) | (color << 3) | flags);
+}
 
-class King : public PieceImpl {
-public:
-  King(PlaySide color);
+constexpr Piece piece_type(PieceCode piece) {
+  return (Piece)((piece & 7) - 1);
+}
 
-  bool is_king() const override;
+constexpr PlaySide piece_color(PieceCode piece) {
+  return (PlaySide)((piece >> 3) & 1);
+}
 
-  std::vector<std::pair<int, int>> get_vision(const GameState &state, int x, int y) override;
+constexpr bool is_promoted(PieceCode piece) {
+  return piece & PROMOTED_FLAG;
+}
 
-  void move_piece(GameState &state, int x, int y, int new_x, int new_y) final;
-  void set_first_move(bool value) override;
-  bool get_first_move() const override;
-  Piece get_type() const override;
+// the per color constants, they fold away wherever the color is a template parameter
+template <PlaySide Us>
+constexpr Bitboard pawn_push(Bitboard b) {
+  return (Us == PlaySide::WHITE) ? b << 8 : b >> 8;
+}
 
-protected:
-  bool first_move;
-};
+template <PlaySide Us>
+constexpr Bitboard relative_rank(Bitboard white_rank) {
+  return (Us == PlaySide::WHITE) ? white_rank : __builtin_bswap64(white_rank);
+}
 
-inline PieceImpl* PromotedPieceFactory(Piece p, PlaySide color) {
-  PieceImpl *tmp;
-  if (p == Piece::QUEEN) {
-    tmp = new Queen(color);
-  } else if (p == Piece::KNIGHT) {
-    tmp = new Knight(color);
-  } else if (p == Piece::BISHOP) {
-    tmp = new Bishop(color);
-  } else {
-    tmp = new Rook(color);
-    tmp->set_first_move(false);
+// squares the piece of the side Us standing on sq can move to, own pieces excluded
+template <PlaySide Us>
+inline Bitboard piece_vision(Piece type, int sq, Bitboard own, Bitboard enemy) {
+  switch (type) {
+    case Piece::PAWN: {
+      Bitboard empty = ~(own | enemy);
+      Bitboard vision = pawn_push<Us>(square_bb(sq)) & empty;
+      if (square_bb(sq) & relative_rank<Us>(RANK_2))
+        vision |= pawn_push<Us>(vision) & empty;
+      return vision | (pawn_attacks[Us][sq] & enemy);
+    }
+    case Piece::KNIGHT:
+      return knight_attacks[sq] & ~own;
+    case Piece::BISHOP:
+      return bishop_attacks(sq, own | enemy) & ~own;
+    case Piece::ROOK:
+      return rook_attacks(sq, own | enemy) & ~own;
+    case Piece::QUEEN:
+      return queen_attacks(sq, own | enemy) & ~own;
+    default:
+      return king_attacks[sq] & ~own;
   }
-
-  tmp->is_promoted = true;
-  return tmp;
 }
+// squares the piece standing on sq attacks, own pieces included
+Bitboard piece_attacks(PieceCode piece, int sq, Bitboard occupancy);
 
 #endif //CHESSBOT_PIECES_HPP
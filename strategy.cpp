@@ -1,14 +1,44 @@
 #include "strategy_constants.h"
 #include "strategy.h"
 #include "ttables.h"
+#include "movepick.h"
+#include "pawns.h"
+#include <atomic>
+#include <thread>
+#ifdef __linux__
+#include <pthread.h>
+#endif
 
 std::unordered_map<int, int> tt_table[MAX_DEPTH + 1];
 auto startTime = std::chrono::high_resolution_clock::now();
-bool timeout;
+// set once the time is up, every search thread stops on it
+std::atomic<bool> timeout;
 
 int MAX_TIME = 7000;
 int MAX_TIME_FORCED = 600;
 
+// two quiet moves per ply that caused a cutoff in a sibling node
+thread_local PackedMove killers[MAX_PLY][2];
+
+int search_threads = 1;
+// set from CHESSBOT_PIN_THREADS, search thread i then runs on cpu i
+static bool pin_threads = getenv("CHESSBOT_PIN_THREADS") != nullptr;
+
+void set_search_threads(int threads) {
+  search_threads = std::clamp(threads, 1, MAX_THREADS);
+}
+
+static void pin_thread(int index) {
+#ifdef __linux__
+  if (!pin_threads)
+    return;
+  cpu_set_t cpus;
+  CPU_ZERO(&cpus);
+  CPU_SET(index % std::max(1u, std::thread::hardware_concurrency()), &cpus);
+  pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+#endif
+}
+
 inline int score_piece(Piece type) {
   if (type == Piece::PAWN)
     return PAWN_SCORE;
@@ -35,20 +65,6 @@ inline int score_piece_hand(Piece type) {
   return QUEEN_HAND_SCORE;
 }
 
-inline int score_piece_attack(Piece type) {
-  if (type == Piece::PAWN)
-    return 6;
-  if (type == Piece::BISHOP)
-    return 4;
-  if (type == Piece::KNIGHT)
-    return 4;
-  if (type == Piece::ROOK)
-    return 3;
-  if (type == Piece::QUEEN)
-    return 1;
-  return 0;
-}
-
 inline int score_piece_undefended(Piece type) {
   if (type == Piece::PAWN)
     return PAWN_SCORE / 8;
@@ -63,10 +79,11 @@ inline int score_piece_undefended(Piece type) {
   return 0;
 }
 
-inline int score_piece_table(Piece type, int x, int y, PlaySide color) {
+template <PlaySide Side>
+inline int score_piece_table(Piece type, int x, int y) {
   int pos2 = (y + 1) * 12 + x + 1;
 
-  if (color == PlaySide::WHITE)
+  if constexpr (Side == PlaySide::WHITE)
     y = 9 - y;
   else
     x = 9 - x;
@@ -75,7 +92,7 @@ inline int score_piece_table(Piece type, int x, int y, PlaySide color) {
 
   int pos = y * 8 + x;
   if (type == Piece::PAWN) {
-    if (color == PlaySide::WHITE)
+    if constexpr (Side == PlaySide::WHITE)
       return white_pawn[pos2];
     return black_pawn[pos2];
   }
@@ -83,207 +100,132 @@ inline int score_piece_table(Piece type, int x, int y, PlaySide color) {
   if (type == Piece::BISHOP)
     return bishop[pos2];
 
-  if (type == Piece::KNIGHT) {
-    if (color == PlaySide::WHITE)
-      return black_knight[pos2];
+  if (type == Piece::KNIGHT)
     return black_knight[pos2];
-  }
 
-  if (type == Piece::ROOK) {
-    if (color == PlaySide::WHITE)
-      return black_rook[pos2];
+  if (type == Piece::ROOK)
     return black_rook[pos2];
-  }
 
   if (type == Piece::QUEEN)
     return queen_table[pos];
   return king_table[pos];
 }
 
-void reorder_moves(std::vector<MoveImpl*> &moves, GameState &state) {
-   auto get_score = [&](MoveImpl* move) -> int {
-    if (move->is_castle()) {
-      return PAWN_SCORE;
-    }
-
-    auto start = move->get_start();
-    auto end = move->get_end();
+// the terms that are the same for both sides, from the point of view of Side
+template <PlaySide Side>
+static int score_side(const GameState &state, const Bitboard attacked[2]) {
+  constexpr PlaySide Them = (Side == PlaySide::WHITE) ? PlaySide::BLACK : PlaySide::WHITE;
+  int score = 0;
 
-    if (start.first < 0) {
-      return score_piece(move->get_drop()) - 1;
-    }
+  // calculate piece values + piece table values
+  Bitboard own = state.occupied[Side];
+  while (own) {
+    int sq = pop_lsb(own);
+    int i = square_x(sq), j = square_y(sq);
+    Piece type = piece_type(state.board[i][j]);
+
+    score += score_piece(type) + score_piece_table<Side>(type, i, j);
+    score += popcount(state.attacks_from[sq] & ~state.occupied[Side]) * MOBILITY;
+
+    // look for undefended pieces
+    if ((attacked[Them] & square_bb(sq)) && !(attacked[Side] & square_bb(sq)))
+      score -= score_piece_undefended(type);
+  }
 
-    if (state.board[end.first][end.second] != nullptr) {
-      return score_piece(state.board[end.first][end.second]->get_type());
-    }
+  // if queen is attacked we lose tempo
+  Bitboard queens = state.pieces[Side][Piece::QUEEN];
+  while (queens)
+    if (attacked[Them] & square_bb(pop_lsb(queens)))
+      score -= PAWN_SCORE / 2;
 
-    return 0;
-  };
+  // bonus points for bishop pair
+  if (popcount(state.pieces[Side][Piece::BISHOP]) > 1)
+    score += BISHOP_PAIR;
 
-  sort(moves.begin(), moves.end(), [&](auto &&a, auto &&b) {
-      return get_score(a) > get_score(b);
-      });
-  //shuffle(moves.begin(), moves.end(), rng);
-}
+  // get value of pieces in hand
+  // every further piece of a type in hand is worth less
+  for (int type = 0; type < 6; ++type)
+    for (int k = 1; k <= state.hand[Side][type]; ++k)
+      score += score_piece_hand((Piece)type) / k - BIG_HAND_PENALTY;
 
-void reorder_perm(std::vector<MoveImpl*> &moves, std::vector<int> &perm) {
-  std::vector<MoveImpl*> copy_moves = moves;
-  for (size_t i = 0; i < copy_moves.size(); ++i)
-    moves[i] = copy_moves[perm[i]];
+  return score;
 }
 
-int eval_state(GameState &state) {
-  int score = 0;
-  PlaySide rev_color = reverse_color(state.color);
-
-  auto moves_my = state.get_moves();
+template <PlaySide Us>
+static int evaluate(GameState &state) {
+  constexpr PlaySide Them = (Us == PlaySide::WHITE) ? PlaySide::BLACK : PlaySide::WHITE;
 
-  if (moves_my.size() == 0) {
-    auto king_pos = state.king_pos(state.color);
-    if (state.square_check(king_pos.first, king_pos.second))
+  if (!state.has_legal_move()) {
+    if (state.in_check())
       return -INF;
     return 0;
   }
 
-  for (auto it : moves_my)
-    delete it;
+  // squares attacked by each side, kings excluded
+  Bitboard attacked[2];
+  attacked[Us] = state.attacked_squares(Us, false);
+  attacked[Them] = state.attacked_squares(Them, false);
 
-  // calculate piece values + piece table values
-  int ap[2][6];
-  int attacked[2][9][9];
-  for (int i = 0; i < 2; ++i)
-    for (int j = 0; j < 6; ++j)
-      ap[i][j] = 0;
-
-  for (int i = 1; i <= 8; ++i)
-    for (int j = 1; j <= 8; ++j)
-      attacked[0][i][j] = attacked[1][i][j] = false;
-
-  for (int i = 1; i <= 8; ++i) {
-    for (int j = 1; j <= 8; ++j) {
-      if (state.board[i][j] == nullptr)
-        continue;
-      PlaySide piece_color = state.board[i][j]->get_color();
-      Piece type = state.board[i][j]->get_type();
-      ++ap[piece_color][type];
-
-      int piece_score = score_piece(type);
-      piece_score += score_piece_table(type, i, j, state.board[i][j]->get_color());
-
-      auto vision = state.board[i][j]->get_vision(state, i, j);
-      piece_score += vision.size() * MOBILITY;
-
-      int val = score_piece_attack(type);
-      for (auto it : vision) {
-        attacked[piece_color][it.first][it.second] = std::max(attacked[piece_color][it.first][it.second], val);
-      }
-
-      if (piece_color == state.color) {
-        score += piece_score;
-      } else {
-        score -= piece_score;
-      }
-    }
-  }
-
-  // attack squares scores
-
-  // if queen is attacked we lose tempo
-  for (int i = 1; i <= 8; ++i) {
-    for (int j = 1; j <= 8; ++j) {
-      if (state.board[i][j] != nullptr && state.board[i][j]->get_type() == Piece::QUEEN) {
-        if (state.board[i][j]->get_color() == state.color && attacked[rev_color][i][j])
-          score -= PAWN_SCORE / 2;
-        else if (state.board[i][j]->get_color() != state.color && attacked[state.color][i][j])
-          score += PAWN_SCORE / 2;
-      }
-    }
-  }
-
-  // look for undefended pieces
-  for (int i = 1; i <= 8; ++i) {
-    for (int j = 1; j <= 8; ++j) {
-      if (state.board[i][j] != nullptr) {
-        PlaySide color = state.board[i][j]->get_color();
-        if (attacked[reverse_color(color)][i][j] && !attacked[color][i][j]) {
-          if (color == state.color)
-            score -= score_piece_undefended(state.board[i][j]->get_type());
-          else
-            score += score_piece_undefended(state.board[i][j]->get_type());
-        }
-      }
-    }
-  }
-
-  // bonus points for bishop pair
-  int nr_pairs = 0;
-  if (ap[state.color][Piece::BISHOP] > 1)
-    ++nr_pairs;
-  if (ap[rev_color][Piece::BISHOP] > 1)
-    --nr_pairs;
-
-  score += nr_pairs * BISHOP_PAIR;
+  int score = score_side<Us>(state, attacked) - score_side<Them>(state, attacked);
+  int pawns = evaluate_pawns(state);
+  score += (Us == PlaySide::WHITE) ? pawns : -pawns;
 
   // bonus points if enemy king is in check and minus points if it is undefended
-  auto king_pos = state.king_pos(state.color);
-  if (state.square_check(king_pos.first, king_pos.second))
+  int king_sq = state.king_square[Us];
+  if (state.attackers[Them][king_sq])
     score += KING_CHECK;
 
-  for (int dx = -1; dx <= 1; ++dx) {
-    int x = dx + king_pos.first;
-    if (x >= 1 && x <= 8) {
-      for (int dy = -1; dy <= 1; ++dy) {
-        int y = dy + king_pos.second;
-        if (y >= 1 && y <= 8) {
-          if (attacked[rev_color][x][y] && !attacked[state.color][x][y])
-            score -= KING_DEFENSE * 2;
-        }
-      }
-    }
-  }
+  // the king zone is the king square and its neighbours
+  Bitboard zone = king_attacks[king_sq] | square_bb(king_sq);
+  score -= popcount(zone & attacked[Them] & ~attacked[Us]) * KING_DEFENSE * 2;
 
-  king_pos = state.king_pos(rev_color);
-  if (state.square_check(king_pos.first, king_pos.second))
+  king_sq = state.king_square[Them];
+  if (state.attackers[Them][king_sq])
     score -= KING_CHECK;
 
-  for (int dx = -1; dx <= 1; ++dx) {
-    int x = dx + king_pos.first;
-    if (x >= 1 && x <= 8) {
-      for (int dy = -1; dy <= 1; ++dy) {
-        int y = dy + king_pos.second;
-        if (y >= 1 && y <= 8) {
-          if (attacked[state.color][x][y] && !attacked[rev_color][x][y])
-            score += KING_DEFENSE * 2;
-        }
-      }
-    }
-  }
+  zone = king_attacks[king_sq] | square_bb(king_sq);
+  score += popcount(zone & attacked[Us] & ~attacked[Them]) * KING_DEFENSE * 2;
 
-  // get value of pieces in hand
-  int f[6];
-  for (int i = 0; i < 6; ++i)
-    f[i] = 0;
-  for (auto it : state.bag[state.color]) {
-    Piece tmp = it->get_type();
-    ++f[tmp];
-    score += score_piece_hand(tmp) / f[tmp];
-  }
-  score -= state.bag[state.color].size() * BIG_HAND_PENALTY;
-
-  for (int i = 0; i < 6; ++i)
-    f[i] = 0;
-  for (auto it : state.bag[rev_color]) {
-    Piece tmp = it->get_type();
-    ++f[tmp];
-    score -= score_piece_hand(tmp) / f[tmp];
-  }
-  score += state.bag[rev_color].size() * BIG_HAND_PENALTY;
+  return score;
+}
+
+int eval_state(GameState &state) {
+  if (state.color == PlaySide::WHITE)
+    return evaluate<PlaySide::WHITE>(state);
+  return evaluate<PlaySide::BLACK>(state);
+}
 
- 
+// leaves go through the eval cache, transpositions by drop order reach the same ones often
+static int cached_eval(GameState &state) {
+  int64_t hash = state.hash();
+  int score;
+  if (probe_eval(hash, score))
+    return score;
 
+  score = eval_state(state);
+  store_eval(hash, score);
   return score;
 }
 
+// a stored result answers the node if it was searched at least as deep and its bound is on the right side of the window
+static bool tt_cutoff(const table_info &entry, int depth, int alpha, int beta) {
+  if (entry.depth < depth)
+    return false;
+  if (entry.flag == FLAG_EXACT)
+    return true;
+  if (entry.flag == FLAG_LOWER)
+    return entry.score >= beta;
+  return entry.score <= alpha;
+}
+
+static int bound_flag(int score, int alpha, int beta) {
+  if (score >= beta)
+    return FLAG_LOWER;
+  if (score <= alpha)
+    return FLAG_UPPER;
+  return FLAG_EXACT;
+}
+
 int negamax_forced(int depth, int alpha, int beta, const int max_depth, GameState &state, const PlaySide first_color) {
   if (timeout)
     return -INF;
@@ -295,66 +237,56 @@ int negamax_forced(int depth, int alpha, int beta, const int max_depth, GameStat
     if (duration.count() >= MAX_TIME_FORCED)
       timeout = true;
 
-    return eval_state(state);
+    return cached_eval(state);
   }
 
-  auto moves = state.get_moves();
-  if (moves.size() == 0) {
-    auto king_pos = state.king_pos(state.color);
-    if (state.square_check(king_pos.first, king_pos.second))
+  MoveList moves;
+  state.get_moves(moves);
+  if (moves.size == 0) {
+    if (state.in_check())
       return -INF;
     return 0;
   }
 
   if (state.color != first_color) {
-    if (moves.size() > MAX_MOVES_FORCED) {
+    if (moves.size > MAX_MOVES_FORCED) {
       auto stopTime = std::chrono::high_resolution_clock::now();
       auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(stopTime - startTime);
 
       if (duration.count() >= MAX_TIME_FORCED)
         timeout = true;
 
-      for (auto it : moves)
-        delete it;
-
       if (depth <= 5)
-        return eval_state(state);
+        return cached_eval(state);
       return INF;
     }
   }
 
-  auto state_hash = calc_hash(state);
+  int alpha_orig = alpha;
+  auto state_hash = state.hash();
   auto ret = get_entry(state_hash);
-  bool found = false;
 
-  if (ret.hash != 0 && ret.best < (int)moves.size()) {
-    if (depth <= ret.depth && max_depth == ret.max_depth) {
-      if (ret.flag == FLAG_EXACT || ret.score >= beta) {
-        for (auto it : moves)
-          delete it;
-        return ret.score;
-      }
-    }
-    std::swap(moves[ret.best], moves[0]);
-    found = true;
+  auto tt_pos = std::find(moves.begin(), moves.end(), ret.best);
+  if (ret.hash != 0 && tt_pos != moves.end()) {
+    if (tt_cutoff(ret, depth, alpha, beta))
+      return ret.score;
+    std::swap(*tt_pos, moves[0]);
   }
 
-  std::string curr_moves;
   int score = -INF;
 
-  std::vector<std::pair<int, int>> values;
-  int inc = 1, best_pos = 0;
+  int inc = 1;
+  PackedMove best_move = MOVE_NONE;
   bool found_move = false;
-  for (size_t pos = 0; pos < moves.size(); pos += inc) {
+  for (int pos = 0; pos < moves.size; pos += inc) {
     auto move = moves[pos];
-    move->exec_move(state);
+    state.exec_move(move);
     state.color = reverse_color(state.color);
 
     if (state.color != first_color) {
-      auto king_pos = state.king_pos(state.color);
-      if (!state.square_check(king_pos.first, king_pos.second)) {
+      if (!state.in_check()) {
         state.color = reverse_color(state.color);
-        move->undo_move(state);
+        state.undo_move(move);
         continue;
       }
     }
@@ -371,11 +303,11 @@ int negamax_forced(int depth, int alpha, int beta, const int max_depth, GameStat
     found_move = true;
 
     state.color = reverse_color(state.color);
-    move->undo_move(state);
+    state.undo_move(move);
 
     if (move_score > score) {
       score = move_score;
-      best_pos = pos;
+      best_move = move;
       alpha = std::max(alpha, score);
     }
 
@@ -384,31 +316,94 @@ int negamax_forced(int depth, int alpha, int beta, const int max_depth, GameStat
     }
   }
 
-  for (auto it : moves)
-    delete it;
-
   if (timeout)
     return -INF;
 
   if (!found_move && state.color == first_color)
     return -INF;
 
-  if (found) {
-    if (best_pos == 0)
-      best_pos = ret.best;
-    else if (best_pos == ret.best)
-      best_pos = 0;
+  add_entry(state_hash, depth, score, best_move, bound_flag(score, alpha_orig, beta));
+
+  return score;
+}
+
+// nodes of the quiescence search, per thread like the killers
+thread_local uint64_t qnodes;
+
+// what taking the piece is worth: it leaves the board and comes to our hand
+static int capture_gain(PieceCode victim) {
+  return score_piece(piece_type(victim)) + score_piece_hand(GameState::hand_type(victim));
+}
+
+// captures and promotions only past the horizon, so that leaves are only scored when quiet
+static int quiesce(int alpha, int beta, GameState &state) {
+  ++qnodes;
+  if (timeout)
+    return -INF;
+
+  int alpha_orig = alpha;
+  auto state_hash = state.hash();
+  auto ret = get_entry(state_hash);
+  if (ret.hash != 0 && tt_cutoff(ret, 0, alpha, beta))
+    return ret.score;
+
+  // in check there is no standing pat, every evasion is searched instead
+  bool in_check = state.in_check();
+  int stand_pat = -INF;
+  if (!in_check || state.ply >= MAX_PLY - 1) {
+    stand_pat = cached_eval(state);
+    if (stand_pat >= beta || state.ply >= MAX_PLY - 1)
+      return stand_pat;
+    alpha = std::max(alpha, stand_pat);
   }
 
-  if (found || score >= beta)
-    add_entry(state_hash, depth, max_depth, score, best_pos, FLAG_UPPER);
-  else
-    add_entry(state_hash, depth, max_depth, score, best_pos, FLAG_EXACT);
+  PackedMove tt_move = (ret.hash != 0 && !is_quiet(state, ret.best)) ? ret.best : MOVE_NONE;
+  MovePicker picker(state, tt_move, nullptr, !in_check);
+  int score = stand_pat;
+  int count = 0;
+  PackedMove best_move = MOVE_NONE;
+  for (PackedMove move = picker.next_move(); move != MOVE_NONE; move = picker.next_move()) {
+    ++count;
+    if (!in_check && move_kind(move) != MOVE_PROMOTION) {
+      PieceCode victim = state.board[square_x(move_to(move))][square_y(move_to(move))];
+      if (stand_pat + capture_gain(victim) + DELTA_MARGIN <= alpha)
+        continue;
+    }
+
+    state.exec_move(move);
+    state.color = reverse_color(state.color);
+    prefetch_entry(state.hash());
+    int move_score = -quiesce(-beta, -alpha, state);
+    state.color = reverse_color(state.color);
+    state.undo_move(move);
 
+    if (move_score > score) {
+      score = move_score;
+      best_move = move;
+      alpha = std::max(alpha, score);
+    }
+    if (alpha >= beta)
+      break;
+  }
+
+  if (in_check && count == 0)
+    return -INF;
+  if (timeout)
+    return -INF;
+
+  add_entry(state_hash, 0, score, best_move, bound_flag(score, alpha_orig, beta));
   return score;
 }
 
-int negamax(int depth, int alpha, int beta, const int max_depth, GameState &state) {
+// a side with pieces in hand can almost always drop one usefully, so passing is only safe with a hand
+static bool null_move_allowed(const GameState &state) {
+  int in_hand = 0;
+  for (int type = 0; type < 6; ++type)
+    in_hand += state.hand[state.color][type];
+  return in_hand >= NULL_MOVE_HAND && !state.in_check();
+}
+
+int negamax(int depth, int alpha, int beta, const int max_depth, GameState &state, bool allow_null = true) {
   if (timeout)
     return -INF;
 
@@ -419,53 +414,62 @@ int negamax(int depth, int alpha, int beta, const int max_depth, GameState &stat
     if (duration.count() >= MAX_TIME)
       timeout = true;
 
-    return eval_state(state);
+    return quiesce(alpha, beta, state);
     //return tt_table[depth][hash] = eval_state(state);
     //return {eval_state(state), ""};
   }
 
-  auto moves = state.get_moves();
-  if (moves.size() == 0) {
-    auto king_pos = state.king_pos(state.color);
-    if (state.square_check(king_pos.first, king_pos.second))
-      return -INF;
-      //return {-INF, ""};
-    return 0;
-    //return {0, ""};
-  }
-
-  auto state_hash = calc_hash(state);
+  int alpha_orig = alpha;
+  auto state_hash = state.hash();
   auto ret = get_entry(state_hash);
-  bool found = false;
+  PackedMove tt_move = MOVE_NONE;
 
-  //if (depth >= max_depth - 2)
-  reorder_moves(moves, state);
+  if (ret.hash != 0) {
+    if (tt_cutoff(ret, depth, alpha, beta))
+      return ret.score;
+    tt_move = ret.best;
+  }
 
-  if (ret.hash != 0 && ret.best < (int)moves.size()) {
-    if (depth <= ret.depth && max_depth == ret.max_depth) {
-      if (ret.flag == FLAG_EXACT || ret.score >= beta) {
-        for (auto it : moves)
-          delete it;
-        return ret.score;
-      }
+  // null move: if passing still fails high, a real move will too
+  if (allow_null && depth >= NULL_MOVE_DEPTH && beta < SCORE_STEP && null_move_allowed(state)
+      && cached_eval(state) >= beta) {
+    int reduction = 2 + depth / 4;
+    state.exec_null_move();
+    state.color = reverse_color(state.color);
+    int null_score = -negamax(std::max(depth - 1 - reduction, 0), -beta, -beta + 1, max_depth, state, false);
+    state.color = reverse_color(state.color);
+    state.undo_null_move();
+
+    if (timeout)
+      return -INF;
+    if (null_score >= beta) {
+      // deep cutoffs are checked by a reduced search of the node without null moves
+      if (depth < NULL_VERIFY_DEPTH
+          || negamax(depth - reduction, beta - 1, beta, max_depth, state, false) >= beta)
+        return beta;
     }
-    std::swap(moves[ret.best], moves[0]);
-    found = true;
   }
 
-  std::string curr_moves;
+  int ply = max_depth - depth;
+  MovePicker picker(state, tt_move, killers[ply]);
+  bool found = false;
+
   int score = -INF;
 
-  std::vector<std::pair<int, int>> values;
-  int inc = 1, best_pos = 0;
-  for (size_t pos = 0; pos < moves.size(); pos += inc) {
-    auto move = moves[pos];
+  int count = 0;
+  PackedMove best_move = MOVE_NONE;
+  for (PackedMove move = picker.next_move(); move != MOVE_NONE; move = picker.next_move()) {
+    // the picker returns the TT move first, and only if it is legal here
+    if (count == 0 && move == tt_move)
+      found = true;
+    bool quiet = is_quiet(state, move);
     //auto hash_move = move->get_hash(state);
-    move->exec_move(state);
+    state.exec_move(move);
     state.color = reverse_color(state.color);
+    prefetch_entry(state.hash());
 
     int move_score;
-    if (!found || pos == 0) {
+    if (!found || count == 0) {
       move_score = -negamax(depth - 1, -beta, -alpha, max_depth, state);
     } else {
       move_score = -negamax(depth - 1, -(alpha + 1), -alpha, max_depth, state);
@@ -482,44 +486,43 @@ int negamax(int depth, int alpha, int beta, const int max_depth, GameState &stat
     //moves_str = ret.second;
 
     state.color = reverse_color(state.color);
-    move->undo_move(state);
+    state.undo_move(move);
+    ++count;
 
     if (move_score > score) {
       score = move_score;
-      best_pos = pos;
+      best_move = move;
       //curr_moves = serializeMove(move->to_engine()) + ", ";
       //curr_moves += moves_str;
       alpha = std::max(alpha, score);
     }
 
     if (alpha >= beta) {
+      if (quiet && killers[ply][0] != move) {
+        killers[ply][1] = killers[ply][0];
+        killers[ply][0] = move;
+      }
       break;
     }
   }
 
-  for (auto it : moves)
-    delete it;
+  if (count == 0) {
+    if (state.in_check())
+      return -INF;
+    return 0;
+  }
 
   if (timeout)
     return -INF;
 
-  if (found) {
-    if (best_pos == 0)
-      best_pos = ret.best;
-    else if (best_pos == ret.best)
-      best_pos = 0;
-  }
-
-  if (found || score >= beta)
-    add_entry(state_hash, depth, max_depth, score, best_pos, FLAG_UPPER);
-  else
-    add_entry(state_hash, depth, max_depth, score, best_pos, FLAG_EXACT);
+  add_entry(state_hash, depth, score, best_move, bound_flag(score, alpha_orig, beta));
   return score;  //return {score, curr_moves};
 }
 
-std::pair<int, MoveImpl*> try_force(GameState &state, std::vector<std::pair<MoveImpl*, int>> &moves_scores) {
+std::pair<int, PackedMove> try_force(GameState &state, std::vector<std::pair<PackedMove, int>> &moves_scores) {
   timeout = false;
   clear_entries();
+  prepare_table();
 
   int alpha = -INF, beta = INF;
   bool first = true;
@@ -527,13 +530,12 @@ std::pair<int, MoveImpl*> try_force(GameState &state, std::vector<std::pair<Move
   const PlaySide color = state.color;
   for (auto &move_score : moves_scores) {
     auto move = move_score.first;
-    move->exec_move(state);
+    state.exec_move(move);
     state.color = reverse_color(state.color);
 
-    auto king_pos = state.king_pos(state.color);
-    if (!state.square_check(king_pos.first, king_pos.second)) {
+    if (!state.in_check()) {
       state.color = reverse_color(state.color);
-      move->undo_move(state);
+      state.undo_move(move);
       continue;
     }
 
@@ -547,7 +549,7 @@ std::pair<int, MoveImpl*> try_force(GameState &state, std::vector<std::pair<Move
     }
 
     state.color = reverse_color(state.color);
-    move->undo_move(state);
+    state.undo_move(move);
 
     if (timeout == true)
       break;
@@ -558,44 +560,15 @@ std::pair<int, MoveImpl*> try_force(GameState &state, std::vector<std::pair<Move
     alpha = std::max(alpha, move_score.second);
   }
 
-  return {0, nullptr};
+  return {0, MOVE_NONE};
 }
 
-MoveImpl* iterative_deepening(GameState &state) {
-  startTime = std::chrono::high_resolution_clock::now();
-
-  auto moves = state.get_moves();
-  reorder_moves(moves, state);
-
-  std::vector<std::pair<MoveImpl*, int>> moves_scores;
-  for (auto move : moves)
-    moves_scores.push_back({move, 0});
-  moves.clear();
-
-  /**
-  auto force = try_force(state, moves_scores);
-  if (force.first >= SCORE_STEP) {
-    std::cerr << "FOUND GOOD FORCED POSITION\n" << std::endl << '\n';
-    std::cerr << force.first << '\n';
-    for (auto move : moves_scores) {
-      if (move.first != force.second)
-        delete move.first;
-    }
-
-    return force.second;
-  } else {
-    auto stopTime = std::chrono::high_resolution_clock::now();
-    auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(stopTime - startTime);
+// the iterative deepening loop of one search thread, leaves the best move first in moves_scores
+static void deepen(GameState &state, std::vector<std::pair<PackedMove, int>> &moves_scores,
+                   int start_depth, int64_t root_hash, bool main_thread) {
+  std::fill(&killers[0][0], &killers[0][0] + MAX_PLY * 2, MOVE_NONE);
 
-    std::cerr << "TIME WASTED ON FORCED MOVE: " << duration.count() << "\n";
-    for (auto &move_score : moves_scores)
-      move_score.second = 0;
-  }
-  **/
-  timeout = false;
-  clear_entries();
-
-  for (int depth = 2; depth <= MAX_DEPTH; ++depth) {
+  for (int depth = start_depth; depth <= MAX_DEPTH; ++depth) {
     int alpha = -INF, beta = INF;
     int cnt = 0;
     for (auto &move_score : moves_scores) {
@@ -603,9 +576,9 @@ MoveImpl* iterative_deepening(GameState &state) {
         continue;
 
       auto move = move_score.first;
-      move->exec_move(state);
+      state.exec_move(move);
       state.color = reverse_color(state.color);
-      if (cnt == 0 || depth == 2) {
+      if (cnt == 0 || depth == start_depth) {
         move_score.second = -negamax(depth - 1, -beta, -alpha, depth, state);
       } else {
         move_score.second = -negamax(depth - 1, -(alpha + 1), -alpha, depth, state);
@@ -614,7 +587,7 @@ MoveImpl* iterative_deepening(GameState &state) {
       }
 
       state.color = reverse_color(state.color);
-      move->undo_move(state);
+      state.undo_move(move);
 
       if (timeout)
         break;
@@ -638,22 +611,79 @@ MoveImpl* iterative_deepening(GameState &state) {
         [&](auto &&x, auto &&y) {
           return x.second > y.second;
         });
+    if (main_thread)
+      add_entry(root_hash, depth, moves_scores[0].second, moves_scores[0].first, FLAG_EXACT);
+  }
+
+}
 
+PackedMove iterative_deepening(GameState &state) {
+  startTime = std::chrono::high_resolution_clock::now();
+
+  MovePicker picker(state, MOVE_NONE, nullptr);
+  std::vector<std::pair<PackedMove, int>> moves_scores;
+  for (PackedMove move = picker.next_move(); move != MOVE_NONE; move = picker.next_move())
+    moves_scores.push_back({move, 0});
+
+  /**
+  auto force = try_force(state, moves_scores);
+  if (force.first >= SCORE_STEP) {
+    std::cerr << "FOUND GOOD FORCED POSITION\n" << std::endl << '\n';
+    std::cerr << force.first << '\n';
+    return force.second;
+  } else {
+    auto stopTime = std::chrono::high_resolution_clock::now();
+    auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(stopTime - startTime);
+
+    std::cerr << "TIME WASTED ON FORCED MOVE: " << duration.count() << "\n";
+    for (auto &move_score : moves_scores)
+      move_score.second = 0;
+  }
+  **/
+  timeout = false;
+  new_search();
+  eval_stats = {0, 0};
+  qnodes = 0;
+  prepare_table();
+
+  // the previous searches already looked at this position, start from what they found
+  auto root_hash = state.hash();
+  auto root = get_entry(root_hash);
+  int start_depth = 2;
+  if (root.hash != 0) {
+    start_depth = std::clamp(root.depth, 2, MAX_DEPTH);
+    auto tt_pos = std::find_if(moves_scores.begin(), moves_scores.end(),
+        [&](auto &&x) { return x.first == root.best; });
+    if (tt_pos != moves_scores.end())
+      std::rotate(moves_scores.begin(), tt_pos, tt_pos + 1);
+  }
+
+  // the helpers search copies of the position, half of them one ply deeper, and only share the table
+  std::vector<GameState> positions(search_threads - 1, state);
+  std::vector<std::thread> helpers;
+  for (int i = 1; i < search_threads; ++i) {
+    helpers.emplace_back([&positions, moves_scores, start_depth, root_hash, i]() mutable {
+        pin_thread(i);
+        deepen(positions[i - 1], moves_scores, start_depth + i % 2, root_hash, false);
+        });
   }
 
-  auto best_move = moves_scores[0].first;
-  for (size_t i = 1; i < moves_scores.size(); ++i)
-    delete moves_scores[i].first;
+  pin_thread(0);
+  deepen(state, moves_scores, start_depth, root_hash, true);
+  timeout = true;
+  for (std::thread &helper : helpers)
+    helper.join();
 
-  return best_move;
+  print_eval_stats();
+  std::cerr << "quiescence: " << qnodes << " nodes\n";
+  return moves_scores[0].first;
 }
 
 int n_moves = 0;
-MoveImpl* find_move(GameState &state) {
+PackedMove find_move(GameState &state) {
   n_moves += 1;
   if (n_moves == 60)
     MAX_TIME = 1900;
 
-  init_hash();
   return iterative_deepening(state);
 }
@@ -1,4 +1,9 @@
 #include "gamestate.h"
 
-MoveImpl* find_move(GameState &state);
+// most search threads the xboard cores command can ask for
+constexpr int MAX_THREADS = 64;
+
+PackedMove find_move(GameState &state);
+// the number of threads searching each move, the main one included
+void set_search_threads(int threads);
 
@@ -9,6 +9,13 @@ constexpr int ATTACKED = 1;
 constexpr int BISHOP_PAIR = 10;
 constexpr int KING_CHECK = 20;
 constexpr int KING_DEFENSE = 5;
+// slack for positional gains when the quiescence search skips captures that cannot reach alpha
+constexpr int DELTA_MARGIN = 200;
+// null move pruning: shallowest node it is tried at, pieces the side to move needs in hand,
+// and the depth from which a null move cutoff is verified by a reduced search
+constexpr int NULL_MOVE_DEPTH = 3;
+constexpr int NULL_MOVE_HAND = 2;
+constexpr int NULL_VERIFY_DEPTH = 8;
 
 constexpr int PAWN_SCORE = 134;
 constexpr int KNIGHT_SCORE = 235;
@@ -1,97 +1,289 @@
 #include "ttables.h"
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+#ifdef __linux__
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
-constexpr int table_size = (1 << 20);
-constexpr int entry_limit = 128;
-constexpr int hash_codes = 1 + 8 * 8 * 6 * 2 + 6 * 2;
+constexpr size_t DEFAULT_TABLE_MB = 16;
 
-std::mt19937_64 rng(std::chrono::steady_clock::now().time_since_epoch().count());
+// a power of two, set by resize_table
+static uint64_t cluster_count;
+static size_t table_bytes;
+static TTCluster *table;
+// mapped from CHESSBOT_SHARED_TT, other processes write to it too
+static bool table_shared;
+// set by clear_entries, the clearing itself waits for the next prepare_table
+static bool table_dirty;
+// bumped by new_search, entries of older searches are replaced first
+static uint8_t generation;
 
-std::vector<table_info> table[table_size];
+// an entry unpacked from its data word
+struct EntryData {
+  PackedMove move;
+  int score;
+  int depth;
+  int gen_bound;
+};
 
-int64_t hash_table[hash_codes + 1];
+static uint64_t pack_data(PackedMove move, int score, int depth, int gen_bound) {
+  return move | (uint64_t)(uint32_t)score << 16 | (uint64_t)depth << 48 | (uint64_t)gen_bound << 56;
+}
 
-void init_hash() {
-  for (int i = 0; i <= hash_codes; ++i)
-    hash_table[i] = rng();
+static EntryData unpack_data(uint64_t data) {
+  return {(PackedMove)data, (int32_t)(data >> 16), (int)(data >> 48) & 0xFF, (int)(data >> 56)};
 }
 
-int64_t calc_hash(const GameState &state) {
-  int64_t hash = 0;
-  if (state.color == PlaySide::BLACK) {
-    hash = hash_table[0];
-  }
+static TTCluster &cluster_of(int64_t hash) {
+  return table[(uint64_t)hash & (cluster_count - 1)];
+}
 
-  for (int i = 0; i < 8; ++i) {
-    for (int j = 0; j < 8; ++j) {
-      if (state.board[i + 1][j + 1] == nullptr)
-        continue;
-      int type = state.board[i + 1][j + 1]->get_type();
-      int pos;
-      if (state.board[i + 1][j + 1]->get_color() == PlaySide::WHITE)
-        pos = 1 + (i * 8 + j) * 6 + type;
-      else
-        pos = 1 + (8 * 8 * 6) + (i * 8 + j) * 6 + type;
-      hash ^= hash_table[pos];
-    }
-  }
+// reads the entry, data is 0 unless it holds the position
+static uint64_t load_entry(const TTEntry &entry, int64_t hash) {
+  uint64_t key = __atomic_load_n(&entry.key, __ATOMIC_RELAXED);
+  uint64_t data = __atomic_load_n(&entry.data, __ATOMIC_RELAXED);
+  return (key ^ data) == (uint64_t)hash ? data : 0;
+}
 
-  for (auto it : state.bag[PlaySide::WHITE]) {
-    int type = it->get_type();
-    int pos = 1 + 8 * 8 * 6 * 2 + type;
-    hash ^= hash_table[pos];
-  }
+static void store_entry(TTEntry &entry, int64_t hash, uint64_t data) {
+  __atomic_store_n(&entry.key, (uint64_t)hash ^ data, __ATOMIC_RELAXED);
+  __atomic_store_n(&entry.data, data, __ATOMIC_RELAXED);
+}
+
+// how many searches ago the entry was written
+static int entry_age(int gen_bound) {
+  return (generation - (gen_bound >> 2)) & 63;
+}
 
-  for (auto it : state.bag[PlaySide::BLACK]) {
-    int type = it->get_type();
-    int pos = 1 + 8 * 8 * 6 * 2 + 6 + type;
-    hash ^= hash_table[pos];
+int64_t calc_key(const Position &state) {
+  int64_t hash = 0;
+  Bitboard b = state.all;
+  while (b) {
+    int sq = pop_lsb(b);
+    hash ^= piece_key(state.board[square_x(sq)][square_y(sq)], sq);
   }
 
+  for (int c = 0; c < 2; ++c)
+    for (int type = 0; type < 6; ++type)
+      hash ^= hand_key((PlaySide)c, (Piece)type, state.hand[c][type]);
+
+  hash ^= zobrist.castling[state.castling];
+  if (state.ep_square != NO_SQUARE)
+    hash ^= ep_key(state.ep_square);
+
   return hash;
 }
 
-void add_entry(int64_t hash, int depth, int max_depth, int score, int best, int flag) {
-  int rem = hash & (table_size - 1);
-  for (auto &it : table[rem]) {
-    if (it.hash == hash) {
-      if (it.max_depth == max_depth && (depth <= it.depth || it.flag == FLAG_EXACT))
-        return;
-      it = {hash, depth, max_depth, score, best, flag};
-      return;
+
+int64_t calc_pawn_key(const Position &state) {
+  int64_t hash = 0;
+  for (int c = 0; c < 2; ++c) {
+    Bitboard b = state.pieces[c][Piece::PAWN];
+    while (b) {
+      int sq = pop_lsb(b);
+      hash ^= piece_key(state.board[square_x(sq)][square_y(sq)], sq);
     }
   }
+  return hash;
+}
+
+void add_entry(int64_t hash, int depth, int score, PackedMove best, int flag) {
+  TTCluster &cluster = cluster_of(hash);
+  TTEntry *replace = nullptr;
+  int replace_value = 0;
 
-  if ((int)table[rem].size() < entry_limit) {
-    table[rem].push_back({hash, depth, max_depth, score, best});
-  } else {
-    for (auto it = table[rem].begin(); it != table[rem].end(); ++it) {
-      if (it->max_depth != max_depth) {
-        std::swap(*it, table[rem].back());
-        table[rem].back() = {hash, depth, max_depth, score, best, flag};
+  for (TTEntry &entry : cluster.entries) {
+    uint64_t data = load_entry(entry, hash);
+    if (data) {
+      // a deeper result is kept unless the new one is exact, a much deeper one always
+      int old_depth = unpack_data(data).depth;
+      if ((depth < old_depth && flag != FLAG_EXACT) || depth + 4 < old_depth)
         return;
-      }
+      replace = &entry;
+      break;
     }
 
-    for (auto it = table[rem].begin(); it != table[rem].end(); ++it) {
-      if (it->depth > depth) {
-        std::swap(*it, table[rem].back());
-        table[rem].back() = {hash, depth, max_depth, score, best, flag};
-        return;
-      }
+    // otherwise an empty entry, else the shallowest one with the old ones counting as shallower
+    EntryData other = unpack_data(__atomic_load_n(&entry.data, __ATOMIC_RELAXED));
+    int value = other.gen_bound ? other.depth - 4 * entry_age(other.gen_bound) : -1000;
+    if (!replace || value < replace_value) {
+      replace = &entry;
+      replace_value = value;
     }
   }
+
+  store_entry(*replace, hash, pack_data(best, score, depth, (generation << 2) | flag));
+}
+
+// anonymous memory comes back zeroed, so a new table is already empty
+static TTCluster *allocate_table(size_t bytes) {
+#ifdef __linux__
+  // explicit huge pages when the host reserved some, transparent ones otherwise
+  void *mem = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+  if (mem == MAP_FAILED) {
+    mem = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED)
+      return nullptr;
+    madvise(mem, bytes, MADV_HUGEPAGE);
+  }
+  return (TTCluster *)mem;
+#else
+  return (TTCluster *)calloc(1, bytes);
+#endif
+}
+
+static void free_table() {
+  if (!table)
+    return;
+#ifdef __linux__
+  munmap(table, table_bytes);
+#else
+  free(table);
+#endif
+  table = nullptr;
+  table_shared = false;
+}
+
+#ifdef __linux__
+// maps the table named by CHESSBOT_SHARED_TT, or returns nullptr to fall back to a private one
+static TTCluster *map_shared_table(const char *name) {
+  int fd = (name[0] == '/') ? shm_open(name, O_RDWR | O_CREAT, 0666) : open(name, O_RDWR | O_CREAT, 0666);
+  if (fd < 0)
+    return nullptr;
+
+  struct stat st;
+  if (fstat(fd, &st) < 0 || (st.st_size == 0 && ftruncate(fd, table_bytes) < 0)) {
+    close(fd);
+    return nullptr;
+  }
+  // the process that created the table decided its size
+  if (st.st_size != 0) {
+    cluster_count = st.st_size / sizeof(TTCluster);
+    while (cluster_count & (cluster_count - 1))
+      cluster_count &= cluster_count - 1;
+    table_bytes = cluster_count * sizeof(TTCluster);
+  }
+
+  void *mem = cluster_count ? mmap(nullptr, table_bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+  close(fd);
+  return (mem == MAP_FAILED) ? nullptr : (TTCluster *)mem;
+}
+#endif
+
+void resize_table(size_t megabytes) {
+  uint64_t clusters = std::max<size_t>(megabytes, 1) * (1 << 20) / sizeof(TTCluster);
+  // the index is a mask of the key, keep the largest power of two that fits
+  while (clusters & (clusters - 1))
+    clusters &= clusters - 1;
+  if (clusters == cluster_count)
+    return;
+
+  free_table();
+  cluster_count = clusters;
+  table_bytes = cluster_count * sizeof(TTCluster);
+  table_dirty = false;
 }
 
 void clear_entries() {
-  for (int i = 0; i < table_size; ++i)
-    table[i].clear();
+  table_dirty = true;
+  new_search();
+}
+
+void new_search() {
+  generation = (generation + 1) & 63;
+}
+
+void prepare_table() {
+  if (!cluster_count)
+    resize_table(DEFAULT_TABLE_MB);
+
+  if (!table) {
+#ifdef __linux__
+    if (const char *name = getenv("CHESSBOT_SHARED_TT")) {
+      table = map_shared_table(name);
+      table_shared = table != nullptr;
+      if (!table_shared)
+        std::cerr << "could not map the shared table " << name << ", using a private one\n";
+    }
+#endif
+    // retry with half the size if the host refuses the memory
+    while (!table && !(table = allocate_table(table_bytes)) && cluster_count > 1) {
+      cluster_count /= 2;
+      table_bytes /= 2;
+    }
+    table_dirty = false;
+    return;
+  }
+
+  // the other processes still use what is in a shared table
+  if (!table_dirty || table_shared) {
+    table_dirty = false;
+    return;
+  }
+
+  // every thread clears its own slice
+  int threads = std::max(1u, std::thread::hardware_concurrency());
+  uint64_t slice = (cluster_count + threads - 1) / threads;
+  std::vector<std::thread> workers;
+  for (int i = 0; i < threads; ++i) {
+    uint64_t begin = std::min(cluster_count, i * slice);
+    uint64_t end = std::min(cluster_count, begin + slice);
+    workers.emplace_back([begin, end]() {
+        std::fill(table + begin, table + end, TTCluster{});
+        });
+  }
+  for (std::thread &worker : workers)
+    worker.join();
+  table_dirty = false;
 }
 
-const table_info& get_entry(int64_t hash) {
-  int rem = hash & (table_size - 1);
-  for (auto &it : table[rem])
-    if (it.hash == hash)
-      return it;
+table_info get_entry(int64_t hash) {
+  for (TTEntry &entry : cluster_of(hash).entries) {
+    uint64_t data = load_entry(entry, hash);
+    if (data) {
+      EntryData found = unpack_data(data);
+      // an entry that is still useful counts as written by this search
+      if (entry_age(found.gen_bound))
+        store_entry(entry, hash, pack_data(found.move, found.score, found.depth, (generation << 2) | (found.gen_bound & 3)));
+      return {hash, found.depth, found.score, found.move, found.gen_bound & 3};
+    }
+  }
 
   return null_info; 
 }
+
+void prefetch_entry(int64_t hash) {
+  __builtin_prefetch(&cluster_of(hash));
+}
+
+constexpr size_t eval_cache_size = EVAL_CACHE_MB * (1 << 20) / sizeof(TTEntry);
+static_assert((eval_cache_size & (eval_cache_size - 1)) == 0, "the eval cache is indexed by a mask");
+
+static TTEntry eval_cache[eval_cache_size];
+thread_local EvalCacheStats eval_stats;
+
+bool probe_eval(int64_t hash, int &score) {
+  ++eval_stats.probes;
+  uint64_t data = load_entry(eval_cache[(uint64_t)hash & (eval_cache_size - 1)], hash);
+  if (!data)
+    return false;
+
+  ++eval_stats.hits;
+  score = (int32_t)data;
+  return true;
+}
+
+void store_eval(int64_t hash, int score) {
+  store_entry(eval_cache[(uint64_t)hash & (eval_cache_size - 1)], hash,
+              (uint32_t)score | (1ULL << 32));
+}
+
+void print_eval_stats() {
+  std::cerr << "eval cache: " << eval_stats.hits << " hits / " << eval_stats.probes << " probes ("
+            << (eval_stats.probes ? 100 * eval_stats.hits / eval_stats.probes : 0) << "%), "
+            << sizeof(eval_cache) / (1 << 20) << " MB\n";
+}
@@ -1,19 +1,151 @@
 #pragma once
 #include "gamestate.h"
 
+// the stored score is exact, at least the score (the node failed high) or at most the score (it failed low)
 constexpr int FLAG_EXACT = 1;
-constexpr int FLAG_UPPER = 2;
+constexpr int FLAG_LOWER = 2;
+constexpr int FLAG_UPPER = 3;
 
+// what a probe returns, hash is 0 when the position is not in the table
 struct table_info {
   int64_t hash; 
-  int depth, max_depth, score, best;
+  int depth, score;
+  PackedMove best;
   int flag;
 };
 
-const table_info null_info = {0, 0, 0, 0, 0, 0};
+const table_info null_info = {0, 0, 0, 0, 0};
 
-void init_hash();
-int64_t calc_hash(const GameState &state);
-void add_entry(int64_t hash, int depth, int max_depth, int score, int best, int flag);
+/**
+ * A stored entry is two words, written and read without locks. data packs
+ * the move (bits 0-15), the score (16-47), the depth (48-55) and the
+ * generation and flag (56-63, generation in the high 6 bits). key holds the
+ * position key xored with data, so a word torn by a concurrent writer fails
+ * the key check instead of returning a mixed entry. data == 0 is an empty
+ * entry, every stored flag is nonzero.
+ */
+struct TTEntry {
+  uint64_t key;
+  uint64_t data;
+};
+
+constexpr int CLUSTER_SIZE = 4;
+
+// one cache line of entries, a probe only ever touches its own cluster
+struct alignas(64) TTCluster {
+  TTEntry entries[CLUSTER_SIZE];
+};
+
+static_assert(sizeof(TTCluster) == 64, "a cluster must fill exactly one cache line");
+
+// most pieces of one type a hand can hold (all 16 pawns)
+constexpr int MAX_HAND = 16;
+
+/**
+ * Zobrist keys. A hand is keyed by how many pieces of each type it holds,
+ * so that two pawns in hand do not cancel out like xoring a key per piece would.
+ */
+struct ZobristKeys {
+  int64_t side;
+  int64_t pieces[2][6][SQUARE_NB];
+  // xored on top of the piece key for promoted pieces
+  int64_t promoted[SQUARE_NB];
+  int64_t hand[2][6][MAX_HAND + 1];
+  int64_t castling[16];
+  int64_t ep[8];
+};
+
+// splitmix64
+constexpr uint64_t next_key(uint64_t &seed) {
+  uint64_t z = (seed += 0x9E3779B97F4A7C15ULL);
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+  return z ^ (z >> 31);
+}
+
+// keys come from a fixed seed at compile time, so searches are reproducible between runs
+constexpr ZobristKeys make_zobrist_keys() {
+  ZobristKeys keys{};
+  uint64_t seed = 1070372;
+
+  keys.side = next_key(seed);
+  for (int c = 0; c < 2; ++c)
+    for (int type = 0; type < 6; ++type)
+      for (int sq = 0; sq < SQUARE_NB; ++sq)
+        keys.pieces[c][type][sq] = next_key(seed);
+  for (int sq = 0; sq < SQUARE_NB; ++sq)
+    keys.promoted[sq] = next_key(seed);
+  // an empty hand adds nothing to the key
+  for (int c = 0; c < 2; ++c)
+    for (int type = 0; type < 6; ++type)
+      for (int count = 1; count <= MAX_HAND; ++count)
+        keys.hand[c][type][count] = next_key(seed);
+  for (int rights = 0; rights < 16; ++rights)
+    keys.castling[rights] = next_key(seed);
+  for (int file = 0; file < 8; ++file)
+    keys.ep[file] = next_key(seed);
+
+  return keys;
+}
+
+inline constexpr ZobristKeys zobrist = make_zobrist_keys();
+
+inline int64_t piece_key(PieceCode piece, int sq) {
+  int64_t key = zobrist.pieces[piece_color(piece)][piece_type(piece)][sq];
+  return is_promoted(piece) ? key ^ zobrist.promoted[sq] : key;
+}
+
+inline int64_t hand_key(PlaySide color, Piece type, int count) {
+  return zobrist.hand[color][type][count];
+}
+
+inline int64_t side_key(PlaySide color) {
+  return (color == PlaySide::BLACK) ? zobrist.side : 0;
+}
+
+inline int64_t ep_key(int sq) {
+  return zobrist.ep[sq & 7];
+}
+// key of the board and hands, recomputed from scratch
+int64_t calc_key(const Position &state);
+int64_t calc_pawn_key(const Position &state);
+// depth is the remaining depth of the node, entries of any iteration answer any shallower probe
+void add_entry(int64_t hash, int depth, int score, PackedMove best, int flag);
+/**
+ * When CHESSBOT_SHARED_TT is set the table is shared with every other engine
+ * process using the same value: a name starting with '/' is a POSIX shared
+ * memory object, anything else a file to map. The first process sizes it,
+ * the others take its size, and clear_entries leaves shared tables alone.
+ */
+// sizes the table from the xboard memory command, the memory itself is taken by prepare_table
+void resize_table(size_t megabytes);
+// forgets every entry, the actual clearing is left to prepare_table
 void clear_entries();
-const table_info& get_entry(int64_t hash);
+// starts a new search, the entries of the previous ones are kept but age
+void new_search();
+// allocates or clears the table if needed, called before every search
+void prepare_table();
+table_info get_entry(int64_t hash);
+// starts loading the cluster of the key, called right after a move is made
+void prefetch_entry(int64_t hash);
+
+/**
+ * Static evaluations of leaves, kept apart from the transposition table so
+ * that leaves do not push searched nodes out. Direct mapped TTEntry slots,
+ * the data is the score with bit 32 set so an empty slot never matches.
+ */
+constexpr size_t EVAL_CACHE_MB = 4;
+
+// counted by probe_eval, reset and printed by the search after every move
+struct EvalCacheStats {
+  uint64_t probes;
+  uint64_t hits;
+};
+
+// per thread, the main search thread reports its own
+extern thread_local EvalCacheStats eval_stats;
+
+// true and the score if the position was evaluated before
+bool probe_eval(int64_t hash, int &score);
+void store_eval(int64_t hash, int score);
+void print_eval_stats();